@@ -0,0 +1,38 @@
+#include "chatbrowserbench.h"
+#include "chatbrowser.h"
+
+#include <QTest>
+
+// Messages already in the view before measuring
+static constexpr int HISTORY = 1000;
+
+ChatBrowserBench::ChatBrowserBench()
+{
+}
+
+void ChatBrowserBench::append_data()
+{
+    QTest::addColumn<QString>("content");
+
+    QTest::newRow("text") << "The quick brown fox jumps over the lazy dog";
+    QTest::newRow("link") << "See https://example.com/some/page?with=query for details";
+    QTest::newRow("file") << "neutron://file?id=00112233445566778899aabbccddeeff&name=photo.jpg&size=1048576";
+}
+
+// The view keeps growing, as it does during a conversation
+void ChatBrowserBench::append()
+{
+    QFETCH(QString, content);
+
+    ChatBrowser browser;
+
+    for (int i = 0; i < HISTORY; i++)
+    {
+        browser.append(content, "sender");
+    }
+
+    QBENCHMARK
+    {
+        browser.append(content, "sender");
+    }
+}
@@ -0,0 +1,18 @@
+#ifndef CHATBROWSERBENCH_H
+#define CHATBROWSERBENCH_H
+
+#include <QObject>
+
+// Appending received messages to the chat view
+class ChatBrowserBench : public QObject
+{
+    Q_OBJECT
+public:
+    explicit ChatBrowserBench();
+
+private slots:
+    void append_data();
+    void append();
+};
+
+#endif // CHATBROWSERBENCH_H
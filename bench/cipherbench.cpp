@@ -0,0 +1,100 @@
+#include "cipherbench.h"
+#include "core/sessioncipher.h"
+
+#include <QTest>
+
+#include <cryptopp/chachapoly.h>
+#include <cryptopp/osrng.h>
+
+Q_DECLARE_METATYPE(SessionCipher::Algorithm)
+
+// From an acknowledgement through a chat message and a file chunk to a large frame
+static const int SIZES[] = { 16, 100, 1024, 4096, 16384, 32768, 65536, 1 << 20 };
+
+static void populate()
+{
+    QTest::addColumn<int>("size");
+
+    for (auto size : SIZES)
+    {
+        QTest::newRow(qPrintable(QString::number(size))) << size;
+    }
+}
+
+CipherBench::CipherBench()
+{
+}
+
+// Bytes per second is the row size divided by the reported msecs per iteration
+void CipherBench::legacy_data()
+{
+    populate();
+}
+
+// What every frame used to cost: a random IV and a fresh key setup
+void CipherBench::legacy()
+{
+    QFETCH(int, size);
+
+    QVector<quint8> secret(32, 1);
+    QVector<quint8> data(size);
+
+    CryptoPP::AutoSeededRandomPool rng;
+    CryptoPP::XChaCha20Poly1305::Encryption enc;
+
+    quint8 tag[16];
+    quint8 iv[24];
+
+    QBENCHMARK
+    {
+        enc.GetNextIV(rng, iv);
+        enc.SetKeyWithIV(secret.constData(),
+                         secret.size(),
+                         iv,
+                         enc.DefaultIVLength());
+        enc.EncryptAndAuthenticate(data.data(),
+                                   tag,
+                                   sizeof(tag),
+                                   iv,
+                                   sizeof(iv),
+                                   nullptr,
+                                   0,
+                                   data.constData(), data.size());
+    }
+}
+
+void CipherBench::session_data()
+{
+    QTest::addColumn<SessionCipher::Algorithm>("algorithm");
+    QTest::addColumn<int>("size");
+
+    auto aes = QString(SessionCipher::isAesAccelerated() ? "aes-256-gcm" : "aes-256-gcm (software)");
+
+    for (auto size : SIZES)
+    {
+        QTest::newRow(qPrintable(QString("chacha20-poly1305 %1").arg(size)))
+                << SessionCipher::ChaCha20Poly1305 << size;
+        QTest::newRow(qPrintable(QString("%1 %2").arg(aes).arg(size)))
+                << SessionCipher::Aes256Gcm << size;
+    }
+}
+
+void CipherBench::session()
+{
+    QFETCH(SessionCipher::Algorithm, algorithm);
+    QFETCH(int, size);
+
+    QVector<quint8> secret(32, 1);
+    QVector<quint8> data(size);
+
+    SessionCipher cipher;
+    cipher.setSecret(secret, SessionCipher::Client, algorithm);
+
+    quint8 header[3] {};
+    quint8 tag[SessionCipher::TAG_SIZE];
+
+    QBENCHMARK
+    {
+        cipher.encrypt(tag, data.data(), size_t(data.size()), header, sizeof(header));
+    }
+}
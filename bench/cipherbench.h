@@ -0,0 +1,19 @@
+#ifndef CIPHERBENCH_H
+#define CIPHERBENCH_H
+
+#include <QObject>
+
+class CipherBench : public QObject
+{
+    Q_OBJECT
+public:
+    explicit CipherBench();
+
+private slots:
+    void legacy_data();
+    void legacy();
+    void session_data();
+    void session();
+};
+
+#endif // CIPHERBENCH_H
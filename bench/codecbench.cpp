@@ -0,0 +1,120 @@
+#include "codecbench.h"
+#include "core/codec.h"
+
+#include <QDateTime>
+#include <QTest>
+#include <QUuid>
+
+Q_DECLARE_METATYPE(Upload)
+
+static void populate()
+{
+    QTest::addColumn<int>("type");
+
+    QTest::newRow("Message") << int(PacketType::Message);
+    QTest::newRow("Upload") << int(PacketType::Upload);
+}
+
+static Message message()
+{
+    return
+    {
+        QDateTime::currentSecsSinceEpoch(),
+        QUuid::createUuid().toRfc4122(),
+        "username",
+        "The quick brown fox jumps over the lazy dog"
+    };
+}
+
+static Upload upload()
+{
+    return
+    {
+        QUuid::createUuid().toRfc4122(),
+        QByteArray(32768, 'x')
+    };
+}
+
+CodecBench::CodecBench()
+{
+    qRegisterMetaTypeStreamOperators<Message>("Message");
+    qRegisterMetaTypeStreamOperators<Upload>("Upload");
+}
+
+// Frames per second is 1000 divided by the reported msecs per iteration
+void CodecBench::variant_data()
+{
+    populate();
+}
+
+void CodecBench::variant()
+{
+    QFETCH(int, type);
+
+    auto v = type == int(PacketType::Message)
+             ? QVariant::fromValue(message())
+             : QVariant::fromValue(upload());
+
+    QBENCHMARK
+    {
+        QByteArray out;
+        QDataStream ds(&out, QIODevice::WriteOnly);
+        v.save(ds);
+
+        QVariant r;
+        QDataStream in(&out, QIODevice::ReadOnly);
+        r.load(in);
+
+        if (type == int(PacketType::Message))
+        {
+            QVERIFY(r.canConvert<Message>());
+            r.value<Message>();
+        }
+        else
+        {
+            QVERIFY(r.canConvert<Upload>());
+            r.value<Upload>();
+        }
+    }
+}
+
+void CodecBench::codec_data()
+{
+    populate();
+}
+
+void CodecBench::codec()
+{
+    QFETCH(int, type);
+
+    auto m = message();
+    auto u = upload();
+
+    QBENCHMARK
+    {
+        QByteArray out;
+        QDataStream ds(&out, QIODevice::WriteOnly);
+
+        if (type == int(PacketType::Message))
+        {
+            Codec::encode(ds, m);
+        }
+        else
+        {
+            Codec::encode(ds, u);
+        }
+
+        QDataStream in(&out, QIODevice::ReadOnly);
+
+        if (type == int(PacketType::Message))
+        {
+            Message d;
+            QVERIFY(Codec::decode(in, d));
+        }
+        else
+        {
+            Upload d;
+            QVERIFY(Codec::decode(in, d));
+        }
+    }
+}
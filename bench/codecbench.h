@@ -0,0 +1,19 @@
+#ifndef CODECBENCH_H
+#define CODECBENCH_H
+
+#include <QObject>
+
+class CodecBench : public QObject
+{
+    Q_OBJECT
+public:
+    explicit CodecBench();
+
+private slots:
+    void variant_data();
+    void variant();
+    void codec_data();
+    void codec();
+};
+
+#endif // CODECBENCH_H
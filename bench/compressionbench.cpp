@@ -0,0 +1,121 @@
+#include "compressionbench.h"
+#include "corpus.h"
+#include "core/codec.h"
+
+#include <QBuffer>
+#include <QTest>
+
+#include <zlib.h>
+
+// Compact encoded payloads as Transport::endFrame compresses them, into
+// buffers kept across frames
+static void populate()
+{
+    QTest::addColumn<QByteArray>("payload");
+
+    auto corpus = loadCorpus();
+
+    QByteArray message;
+    QByteArray backlog;
+
+    {
+        QBuffer buffer(&message);
+        buffer.open(QIODevice::WriteOnly);
+
+        CompactStream s(&buffer);
+        Codec::encode(s, corpus.value(corpus.size() / 2));
+    }
+
+    {
+        QBuffer buffer(&backlog);
+        buffer.open(QIODevice::WriteOnly);
+
+        CompactStream s(&buffer);
+
+        for (const auto &d : corpus)
+        {
+            Codec::encode(s, d);
+        }
+    }
+
+    QTest::newRow("message") << message;
+    QTest::newRow("backlog") << backlog;
+}
+
+static uLongf compressPayload(const QByteArray &payload, QByteArray &deflated)
+{
+    auto bound = compressBound(uLong(payload.size()));
+    uLongf size = bound;
+
+    deflated.resize(int(bound));
+
+    compress2(reinterpret_cast<Bytef *>(deflated.data()), &size,
+              reinterpret_cast<const Bytef *>(payload.constData()), uLong(payload.size()),
+              Z_DEFAULT_COMPRESSION);
+
+    return size;
+}
+
+CompressionBench::CompressionBench()
+{
+}
+
+void CompressionBench::ratio_data()
+{
+    populate();
+}
+
+void CompressionBench::ratio()
+{
+    QFETCH(QByteArray, payload);
+
+    QByteArray deflated;
+    auto size = compressPayload(payload, deflated);
+
+    qInfo("%d bytes -> %lu bytes (%.1f%%)",
+          payload.size(),
+          size,
+          100.0 * size / payload.size());
+}
+
+void CompressionBench::compress_data()
+{
+    populate();
+}
+
+void CompressionBench::compress()
+{
+    QFETCH(QByteArray, payload);
+
+    QByteArray deflated;
+
+    QBENCHMARK
+    {
+        compressPayload(payload, deflated);
+    }
+}
+
+void CompressionBench::uncompress_data()
+{
+    populate();
+}
+
+void CompressionBench::uncompress()
+{
+    QFETCH(QByteArray, payload);
+
+    QByteArray deflated;
+    auto size = compressPayload(payload, deflated);
+
+    QByteArray inflated;
+
+    QBENCHMARK
+    {
+        uLongf inflatedSize = uLongf(payload.size());
+        inflated.resize(payload.size());
+
+        QCOMPARE(::uncompress(reinterpret_cast<Bytef *>(inflated.data()), &inflatedSize,
+                              reinterpret_cast<const Bytef *>(deflated.constData()), size), Z_OK);
+        QCOMPARE(int(inflatedSize), payload.size());
+    }
+}
@@ -0,0 +1,21 @@
+#ifndef COMPRESSIONBENCH_H
+#define COMPRESSIONBENCH_H
+
+#include <QObject>
+
+class CompressionBench : public QObject
+{
+    Q_OBJECT
+public:
+    explicit CompressionBench();
+
+private slots:
+    void ratio_data();
+    void ratio();
+    void compress_data();
+    void compress();
+    void uncompress_data();
+    void uncompress();
+};
+
+#endif // COMPRESSIONBENCH_H
@@ -0,0 +1,42 @@
+#include "corpus.h"
+
+#include <QDateTime>
+#include <QFile>
+#include <QTest>
+#include <QUuid>
+
+static const QString SENDERS[] { "alice", "bob", "carol", "dave" };
+
+QVector<Message> loadCorpus()
+{
+    QVector<Message> corpus;
+
+    QFile file(QFINDTESTDATA("data/messages.txt"));
+
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        return corpus;
+    }
+
+    auto timestamp = QDateTime::currentSecsSinceEpoch();
+
+    while (!file.atEnd())
+    {
+        auto line = QString::fromUtf8(file.readLine()).trimmed();
+
+        if (line.isEmpty())
+        {
+            continue;
+        }
+
+        corpus.append(
+        {
+            timestamp++,
+            QUuid::createUuid().toRfc4122(),
+            SENDERS[corpus.size() % 4],
+            line
+        });
+    }
+
+    return corpus;
+}
@@ -0,0 +1,9 @@
+#ifndef CORPUS_H
+#define CORPUS_H
+
+#include "core/packet.h"
+
+// Chat messages built from bench/data/messages.txt
+QVector<Message> loadCorpus();
+
+#endif // CORPUS_H
@@ -0,0 +1,98 @@
+#include "encodingbench.h"
+#include "corpus.h"
+#include "core/codec.h"
+
+#include <QBuffer>
+#include <QTest>
+
+template <typename Stream>
+static QByteArray serialize(const QVector<Message> &messages)
+{
+    QByteArray out;
+    QBuffer buffer(&out);
+    buffer.open(QIODevice::WriteOnly);
+
+    Stream s(&buffer);
+
+    for (const auto &message : messages)
+    {
+        Codec::encode(s, message);
+    }
+
+    return out;
+}
+
+EncodingBench::EncodingBench()
+{
+}
+
+void EncodingBench::initTestCase()
+{
+    corpus = loadCorpus();
+    QVERIFY(!corpus.isEmpty());
+}
+
+void EncodingBench::size()
+{
+    auto legacy = serialize<QDataStream>(corpus).size();
+    auto compact = serialize<CompactStream>(corpus).size();
+
+    qInfo("%d messages: legacy %d bytes, compact %d bytes (%.1f%% of legacy)",
+          corpus.size(),
+          legacy,
+          compact,
+          100.0 * compact / legacy);
+
+    QVERIFY(compact < legacy);
+}
+
+void EncodingBench::encode_data()
+{
+    QTest::addColumn<bool>("compact");
+
+    QTest::newRow("legacy") << false;
+    QTest::newRow("compact") << true;
+}
+
+void EncodingBench::encode()
+{
+    QFETCH(bool, compact);
+
+    QBENCHMARK
+    {
+        compact
+        ? serialize<CompactStream>(corpus)
+        : serialize<QDataStream>(corpus);
+    }
+}
+
+void EncodingBench::decode_data()
+{
+    encode_data();
+}
+
+void EncodingBench::decode()
+{
+    QFETCH(bool, compact);
+
+    auto data = compact
+                ? serialize<CompactStream>(corpus)
+                : serialize<QDataStream>(corpus);
+
+    QBENCHMARK
+    {
+        QBuffer buffer(&data);
+        buffer.open(QIODevice::ReadOnly);
+
+        QDataStream ds(&buffer);
+        CompactStream cs(&buffer);
+
+        for (int i = 0; i < corpus.size(); i++)
+        {
+            Message d;
+            QVERIFY(compact
+                    ? Codec::decode(cs, d)
+                    : Codec::decode(ds, d));
+        }
+    }
+}
@@ -0,0 +1,26 @@
+#ifndef ENCODINGBENCH_H
+#define ENCODINGBENCH_H
+
+#include "core/packet.h"
+
+#include <QObject>
+
+class EncodingBench : public QObject
+{
+    Q_OBJECT
+public:
+    explicit EncodingBench();
+
+private slots:
+    void initTestCase();
+    void size();
+    void encode_data();
+    void encode();
+    void decode_data();
+    void decode();
+
+private:
+    QVector<Message> corpus;
+};
+
+#endif // ENCODINGBENCH_H
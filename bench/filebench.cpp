@@ -0,0 +1,73 @@
+#include "filebench.h"
+#include "core/file.h"
+
+#include <QTest>
+
+// Pages wrap around within 64 MiB, so the page cache holds the file
+static constexpr qint64 FILE_SIZE = 64 << 20;
+
+FileBench::FileBench()
+{
+}
+
+void FileBench::initTestCase()
+{
+    QVERIFY(dir.isValid());
+
+    QFile file(dir.filePath("read"));
+
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    QVERIFY(file.resize(FILE_SIZE));
+}
+
+// Bytes per second is PAGE_SIZE divided by the reported msecs per iteration
+void FileBench::read()
+{
+    File file(dir.filePath("read"));
+
+    QVERIFY(file.open(QIODevice::ReadOnly));
+
+    QBENCHMARK
+    {
+        if (file.atEnd())
+        {
+            file.seek(0);
+        }
+
+        file.read(File::PAGE_SIZE);
+    }
+}
+
+// Downloads are sized beforehand and written through the mapping
+void FileBench::write_data()
+{
+    QTest::addColumn<bool>("presized");
+
+    QTest::newRow("appended") << false;
+    QTest::newRow("presized") << true;
+}
+
+void FileBench::write()
+{
+    QFETCH(bool, presized);
+
+    File file(dir.filePath(presized ? "presized" : "appended"));
+    QByteArray page(File::PAGE_SIZE, 'x');
+
+    QVERIFY(file.open(QIODevice::ReadWrite));
+
+    if (presized)
+    {
+        QVERIFY(file.resize(FILE_SIZE));
+    }
+
+    QBENCHMARK
+    {
+        if (file.pos() >= FILE_SIZE)
+        {
+            file.seek(0);
+        }
+
+        file.write(page);
+    }
+}
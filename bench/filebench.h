@@ -0,0 +1,25 @@
+#ifndef FILEBENCH_H
+#define FILEBENCH_H
+
+#include <QObject>
+#include <QTemporaryDir>
+
+// File::read and File::write one page at a time, as transfers do
+class FileBench : public QObject
+{
+    Q_OBJECT
+public:
+    explicit FileBench();
+
+private slots:
+    void initTestCase();
+
+    void read();
+    void write_data();
+    void write();
+
+private:
+    QTemporaryDir dir;
+};
+
+#endif // FILEBENCH_H
@@ -0,0 +1,176 @@
+#include "handshakebench.h"
+#include "core/pqcrypto.h"
+
+#include <QTest>
+
+#include <cryptopp/filters.h>
+#include <cryptopp/sha3.h>
+using CryptoPP::ArraySink;
+using CryptoPP::ArraySource;
+using CryptoPP::HashFilter;
+using CryptoPP::SHA3_512;
+
+Q_DECLARE_METATYPE(Suite::Kem)
+Q_DECLARE_METATYPE(Suite::Signature)
+
+static void populateKems()
+{
+    QTest::addColumn<Suite::Kem>("kem");
+
+    for (auto kem : KeyEncapsulation::available())
+    {
+        QTest::newRow(qPrintable(KeyEncapsulation::getName(kem))) << kem;
+    }
+}
+
+static void populateSignatures()
+{
+    QTest::addColumn<Suite::Signature>("signature");
+
+    for (auto signature : DigitalSignature::available())
+    {
+        QTest::newRow(qPrintable(DigitalSignature::getName(signature))) << signature;
+    }
+}
+
+HandshakeBench::HandshakeBench()
+{
+}
+
+// Done by the server for every connection
+void HandshakeBench::keypair_data()
+{
+    populateKems();
+}
+
+void HandshakeBench::keypair()
+{
+    QFETCH(Suite::Kem, kem);
+
+    KeyEncapsulation algorithm(kem);
+    QVector<quint8> public_key, secret_key;
+
+    QBENCHMARK
+    {
+        QVERIFY(algorithm.generate(public_key, secret_key));
+    }
+}
+
+// Done by the client, in parallel with verify
+void HandshakeBench::encapsulate_data()
+{
+    populateKems();
+}
+
+void HandshakeBench::encapsulate()
+{
+    QFETCH(Suite::Kem, kem);
+
+    KeyEncapsulation algorithm(kem);
+    QVector<quint8> public_key, secret_key, ciphertext, shared_secret;
+
+    QVERIFY(algorithm.generate(public_key, secret_key));
+
+    QBENCHMARK
+    {
+        QVERIFY(algorithm.encapsulate(public_key, ciphertext, shared_secret));
+    }
+}
+
+// Done by the server
+void HandshakeBench::decapsulate_data()
+{
+    populateKems();
+}
+
+void HandshakeBench::decapsulate()
+{
+    QFETCH(Suite::Kem, kem);
+
+    KeyEncapsulation algorithm(kem);
+    QVector<quint8> public_key, secret_key, ciphertext, shared_secret;
+
+    QVERIFY(algorithm.generate(public_key, secret_key));
+    QVERIFY(algorithm.encapsulate(public_key, ciphertext, shared_secret));
+
+    QBENCHMARK
+    {
+        QVERIFY(algorithm.decapsulate(ciphertext, secret_key, shared_secret));
+    }
+}
+
+// Done by the server over every ephemeral public key, Kyber768 sized
+void HandshakeBench::sign_data()
+{
+    populateSignatures();
+}
+
+void HandshakeBench::sign()
+{
+    QFETCH(Suite::Signature, signature);
+
+    DigitalSignature algorithm(signature);
+    QVector<quint8> public_key, secret_key, result;
+    QByteArray message(1184, 'x');
+
+    QVERIFY(algorithm.generate(public_key, secret_key));
+
+    QBENCHMARK
+    {
+        QVERIFY(algorithm.sign(message, secret_key, result));
+    }
+}
+
+// Done by the client, in parallel with encapsulate
+void HandshakeBench::verify_data()
+{
+    populateSignatures();
+}
+
+void HandshakeBench::verify()
+{
+    QFETCH(Suite::Signature, signature);
+
+    DigitalSignature algorithm(signature);
+    QVector<quint8> public_key, secret_key, result;
+    QByteArray message(1184, 'x');
+
+    QVERIFY(algorithm.generate(public_key, secret_key));
+    QVERIFY(algorithm.sign(message, secret_key, result));
+
+    QBENCHMARK
+    {
+        QVERIFY(algorithm.verify(message, result, public_key));
+    }
+}
+
+// The client checks the identity key against the server id it pinned
+void HandshakeBench::serverId()
+{
+    auto signatures = DigitalSignature::available();
+
+    if (signatures.isEmpty())
+    {
+        QSKIP("No signature algorithm available in this liboqs build");
+    }
+
+    DigitalSignature algorithm(signatures.first());
+    QVector<quint8> public_key, secret_key;
+
+    QVERIFY(algorithm.generate(public_key, secret_key));
+
+    QByteArray id;
+
+    QBENCHMARK
+    {
+        SHA3_512 hash;
+        id.resize(hash.DigestSize());
+
+        ArraySource(public_key.constData(),
+                    public_key.size(), true,
+                    new HashFilter(
+                        hash,
+                        new ArraySink(reinterpret_cast<quint8 *>(id.data()), id.size())
+                    ));
+    }
+}
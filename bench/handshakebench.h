@@ -0,0 +1,28 @@
+#ifndef HANDSHAKEBENCH_H
+#define HANDSHAKEBENCH_H
+
+#include <QObject>
+
+// The post-quantum primitives of a full key exchange, one row per
+// algorithm the local liboqs build provides
+class HandshakeBench : public QObject
+{
+    Q_OBJECT
+public:
+    explicit HandshakeBench();
+
+private slots:
+    void keypair_data();
+    void keypair();
+    void encapsulate_data();
+    void encapsulate();
+    void decapsulate_data();
+    void decapsulate();
+    void sign_data();
+    void sign();
+    void verify_data();
+    void verify();
+    void serverId();
+};
+
+#endif // HANDSHAKEBENCH_H
@@ -0,0 +1,49 @@
+#include "loopbackbench.h"
+#include "core/client.h"
+#include "core/file.h"
+#include "core/packet.h"
+
+#include <QAbstractSocket>
+#include <QApplication>
+#include <QDir>
+#include <QStandardPaths>
+#include <QTemporaryDir>
+#include <QTest>
+
+int main(int argc, char *argv[])
+{
+    qRegisterMetaType<QAbstractSocket::SocketError>("SocketError");
+    qRegisterMetaType<QSharedPointer<File>>("QSharedPointer<File>");
+    qRegisterMetaType<QVector<Message>>("QVector<Message>");
+
+    // Client reports errors with message boxes, which need a QApplication
+    if (!qEnvironmentVariableIsSet("QT_QPA_PLATFORM"))
+    {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+
+    QApplication a(argc, argv);
+    a.setApplicationName("neutron-loopback-bench");
+
+    // Keep the archive and settings of a real installation out of reach
+    QStandardPaths::setTestModeEnabled(true);
+
+    QTemporaryDir dir;
+
+    if (!dir.isValid() || !QDir::setCurrent(dir.path()))
+    {
+        return EXIT_FAILURE;
+    }
+
+    Client();
+
+    LoopbackBench loopback;
+    auto status = QTest::qExec(&loopback, argc, argv);
+
+    Client::getWorkerThread()->quit();
+    Client::getWorkerThread()->wait();
+    Client::getPipelineThread()->quit();
+    Client::getPipelineThread()->wait();
+
+    return status;
+}
@@ -0,0 +1,502 @@
+#include "loopbackbench.h"
+#include "core/client.h"
+#include "core/file.h"
+#include "core/pqcrypto.h"
+#include "core/server.h"
+#include "mockserver/mockserver.h"
+
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QHostAddress>
+#include <QRandomGenerator>
+#include <QTest>
+#include <QTimer>
+
+#include <functional>
+
+Q_DECLARE_METATYPE(Suite::Kem)
+Q_DECLARE_METATYPE(Suite::Signature)
+
+// Longest wait for any single step before the benchmark fails
+static constexpr int TIMEOUT = 60000;
+// Handshakes averaged per result, each one is a full post-quantum key exchange
+static constexpr int HANDSHAKES = 5;
+static constexpr qint64 MIB = 1 << 20;
+// Files sent at once by the concurrent upload benchmark
+static constexpr int CONCURRENT_UPLOADS = 4;
+
+// Runs trigger and spins the event loop until sender emits signal
+template <typename Sender, typename Signal, typename Trigger>
+static bool waitFor(const Sender *sender, Signal signal, Trigger trigger)
+{
+    QEventLoop loop;
+
+    QTimer::singleShot(TIMEOUT, &loop, [&]
+    {
+        loop.exit(1);
+    });
+    QObject::connect(sender, signal, &loop, [&]
+    {
+        loop.exit(0);
+    });
+
+    trigger();
+
+    return loop.exec() == 0;
+}
+
+// Runs trigger and spins the event loop until size bytes of id went through
+static bool waitForTransfer(Server *server, QByteArray &id, qint64 size, std::function<void()> trigger)
+{
+    QEventLoop loop;
+    qint64 transferred = 0;
+
+    QTimer::singleShot(TIMEOUT, &loop, [&]
+    {
+        loop.exit(1);
+    });
+    QObject::connect(server, &Server::chunkTransferred, &loop, [&](QByteArray chunk_id, qint64 length)
+    {
+        if (id.isEmpty())
+        {
+            id = chunk_id;
+        }
+
+        transferred += length;
+
+        if (transferred >= size)
+        {
+            loop.exit(0);
+        }
+    });
+    QObject::connect(server, &Server::print, &loop, [&](QString reason)
+    {
+        qWarning().noquote() << reason;
+    });
+
+    trigger();
+
+    return loop.exec() == 0 && transferred == size;
+}
+
+static void populate()
+{
+    QTest::addColumn<qint64>("size");
+
+    QTest::newRow("1 MiB") << MIB;
+    QTest::newRow("16 MiB") << 16 * MIB;
+    QTest::newRow("64 MiB") << 64 * MIB;
+}
+
+LoopbackBench::LoopbackBench()
+    : mock(nullptr)
+    , users(0)
+{
+}
+
+void LoopbackBench::initTestCase()
+{
+    QVERIFY(dir.isValid());
+
+    mock = new MockServer(Suite::Picnic2L5, this);
+    mock->addRoom("Benchmark");
+
+    QVERIFY2(mock->listen(QHostAddress::LocalHost), qPrintable(mock->errorString()));
+}
+
+void LoopbackBench::cleanupTestCase()
+{
+    delete mock;
+}
+
+static bool hasTicket(Server *server)
+{
+    bool kept = false;
+
+    QMetaObject::invokeMethod(server, [&]
+    {
+        kept = server->hasTicket();
+    }, Qt::BlockingQueuedConnection);
+
+    return kept;
+}
+
+// Connecting up to Established, in msecs
+void LoopbackBench::handshake()
+{
+    // Without tickets every connection does the full key exchange
+    Client::getSettings().setValue("Network/Resumption", false);
+
+    qint64 elapsed = 0;
+
+    for (int i = 0; i < HANDSHAKES; i++)
+    {
+        QElapsedTimer timer;
+        timer.start();
+
+        auto server = connectUser();
+        elapsed += timer.elapsed();
+
+        QVERIFY(server);
+        disconnectUser(server);
+    }
+
+    QTest::setBenchmarkResult(qreal(elapsed) / HANDSHAKES, QTest::WalltimeMilliseconds);
+}
+
+void LoopbackBench::suites_data()
+{
+    QTest::addColumn<Suite::Kem>("kem");
+    QTest::addColumn<Suite::Signature>("signature");
+
+    const QVector<QPair<Suite::Kem, Suite::Signature>> suites =
+    {
+        {Suite::SikeP751, Suite::Picnic2L5},
+        {Suite::Kyber768, Suite::Dilithium3},
+        {Suite::Kyber1024, Suite::Dilithium3},
+        {Suite::MlKem768, Suite::MlDsa65}
+    };
+
+    for (const auto &suite : suites)
+    {
+        auto name = QString("%1 %2").arg(KeyEncapsulation::getName(suite.first),
+                                         DigitalSignature::getName(suite.second));
+
+        QTest::newRow(qPrintable(name)) << suite.first << suite.second;
+    }
+}
+
+// Full key exchange with each suite up to Established, in msecs
+void LoopbackBench::suites()
+{
+    QFETCH(Suite::Kem, kem);
+    QFETCH(Suite::Signature, signature);
+
+    if (!KeyEncapsulation(kem).isAvailable() || !DigitalSignature(signature).isAvailable())
+    {
+        QSKIP("Suite not available in this liboqs build");
+    }
+
+    MockServer server(signature);
+    server.addRoom("Benchmark");
+
+    QVERIFY(server.setKem(kem));
+    QVERIFY2(server.listen(QHostAddress::LocalHost), qPrintable(server.errorString()));
+
+    qint64 elapsed = 0;
+    quint64 bytes = 0;
+
+    Client::getSettings().setValue("Network/Resumption", false);
+
+    for (int i = 0; i < HANDSHAKES; i++)
+    {
+        QElapsedTimer timer;
+        timer.start();
+
+        auto client = connectUser(&server);
+        elapsed += timer.elapsed();
+
+        QVERIFY(client);
+
+        Transport::Statistics statistics;
+
+        QMetaObject::invokeMethod(client, [&]
+        {
+            statistics = client->getWriteStatistics();
+        }, Qt::BlockingQueuedConnection);
+
+        bytes += statistics.bytes + statistics.received;
+
+        disconnectUser(client);
+    }
+
+    qInfo("%llu bytes exchanged per connection", bytes / HANDSHAKES);
+
+    QTest::setBenchmarkResult(qreal(elapsed) / HANDSHAKES, QTest::WalltimeMilliseconds);
+}
+
+// Reconnecting with a ticket up to Established, in msecs
+void LoopbackBench::resumption()
+{
+    Client::getSettings().setValue("Network/Resumption", true);
+
+    auto server = connectUser();
+
+    QVERIFY(server);
+    QTRY_VERIFY(hasTicket(server));
+
+    disconnectUser(server);
+
+    qint64 elapsed = 0;
+
+    for (int i = 0; i < HANDSHAKES; i++)
+    {
+        QElapsedTimer timer;
+        timer.start();
+
+        server = connectUser();
+        elapsed += timer.elapsed();
+
+        QVERIFY(server);
+        disconnectUser(server);
+    }
+
+    QTest::setBenchmarkResult(qreal(elapsed) / HANDSHAKES, QTest::WalltimeMilliseconds);
+}
+
+// Round trips per second is 1000 divided by the reported msecs per iteration
+void LoopbackBench::roundTrip()
+{
+    auto alice = connectUser();
+    auto bob = connectUser();
+
+    QVERIFY(alice && bob);
+    QVERIFY(joinRoom(alice) && joinRoom(bob));
+
+    auto send = [](Server * server, const QString & content)
+    {
+        QMetaObject::invokeMethod(server, "sendMessage",
+                                  Q_ARG(qint64, QDateTime::currentSecsSinceEpoch()),
+                                  Q_ARG(QString, content));
+    };
+
+    QBENCHMARK
+    {
+        QVERIFY(waitFor(bob, &Server::messageReceived, [ = ]
+        {
+            send(alice, "ping");
+        }));
+        QVERIFY(waitFor(alice, &Server::messageReceived, [ = ]
+        {
+            send(bob, "pong");
+        }));
+    }
+
+    disconnectUser(alice);
+    disconnectUser(bob);
+}
+
+void LoopbackBench::upload_data()
+{
+    populate();
+}
+
+void LoopbackBench::upload()
+{
+    QFETCH(qint64, size);
+
+    auto path = createFile(size);
+    auto server = connectUser();
+
+    QVERIFY(server);
+
+    QElapsedTimer timer;
+    timer.start();
+
+    QVERIFY(!sendFile(server, path, size).isEmpty());
+
+    QTest::setBenchmarkResult(size * 1000.0 / qMax(timer.elapsed(), qint64(1)), QTest::BytesPerSecond);
+
+    disconnectUser(server);
+}
+
+// Files sent at once share the connection, in bytes per second overall
+void LoopbackBench::concurrentUploads()
+{
+    auto server = connectUser();
+
+    QVERIFY(server);
+
+    QVector<QSharedPointer<File>> files;
+    qint64 total = 0;
+
+    for (int i = 0; i < CONCURRENT_UPLOADS; i++)
+    {
+        // Sizes differ so that every file has its own path
+        auto size = 16 * MIB + i * 4096;
+
+        QSharedPointer<File> file(new File(createFile(size)));
+
+        QVERIFY(file->open(QIODevice::ReadOnly));
+
+        files.append(file);
+        total += size;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    QByteArray id;
+
+    auto send = [ = ]
+    {
+        for (const auto &file : files)
+        {
+            QMetaObject::invokeMethod(server, "sendFile",
+                                      Q_ARG(QSharedPointer<File>, file));
+        }
+    };
+
+    QVERIFY(waitForTransfer(server, id, total, send));
+
+    QTest::setBenchmarkResult(total * 1000.0 / qMax(timer.elapsed(), qint64(1)), QTest::BytesPerSecond);
+
+    disconnectUser(server);
+}
+
+void LoopbackBench::download_data()
+{
+    populate();
+}
+
+void LoopbackBench::download()
+{
+    QFETCH(qint64, size);
+
+    auto path = createFile(size);
+    auto server = connectUser();
+
+    QVERIFY(server);
+
+    auto id = sendFile(server, path, size);
+
+    QVERIFY(!id.isEmpty());
+
+    QSharedPointer<File> file(new File(path + ".received"));
+
+    QVERIFY(file->open(QIODevice::ReadWrite));
+    QVERIFY(file->resize(size));
+
+    QElapsedTimer timer;
+    timer.start();
+
+    auto receive = [ = ]
+    {
+        QMetaObject::invokeMethod(server, "receiveFile",
+                                  Q_ARG(QSharedPointer<File>, file),
+                                  Q_ARG(QByteArray, id));
+    };
+
+    QVERIFY(waitForTransfer(server, id, size, receive));
+
+    QTest::setBenchmarkResult(size * 1000.0 / qMax(timer.elapsed(), qint64(1)), QTest::BytesPerSecond);
+
+    disconnectUser(server);
+
+    QFile sent(path);
+
+    QVERIFY(sent.open(QIODevice::ReadOnly) && file->seek(0));
+    QVERIFY(sent.readAll() == file->readAll());
+}
+
+Server *LoopbackBench::connectUser(MockServer *mock)
+{
+    if (!mock)
+    {
+        mock = this->mock;
+    }
+
+    auto socket = new QTcpSocket;
+
+    auto connectToHost = [ = ]
+    {
+        socket->connectToHost(QHostAddress::LocalHost, mock->serverPort());
+    };
+
+    if (!waitFor(socket, &QTcpSocket::connected, connectToHost))
+    {
+        delete socket;
+        return nullptr;
+    }
+
+    auto server = new Server;
+    server->moveToThread(Client::getWorkerThread());
+    socket->moveToThread(Client::getWorkerThread());
+
+    connect(server, &Server::insertRoom, this, [ = ](QByteArray id)
+    {
+        id_room = id;
+    });
+
+    auto id = QString(mock->getId().toHex());
+    auto username = QString("user%1").arg(users++);
+
+    auto run = [ = ]
+    {
+        QMetaObject::invokeMethod(server, "run",
+                                  Q_ARG(QTcpSocket *, socket),
+                                  Q_ARG(QString, id),
+                                  Q_ARG(QString, username),
+                                  Q_ARG(QString, "password"),
+                                  Q_ARG(bool, true));
+    };
+
+    if (!waitFor(server, &Server::setName, run))
+    {
+        disconnectUser(server);
+        return nullptr;
+    }
+
+    return server;
+}
+
+void LoopbackBench::disconnectUser(Server *server)
+{
+    waitFor(server, &QObject::destroyed, [ = ]
+    {
+        QMetaObject::invokeMethod(server, "close");
+    });
+}
+
+bool LoopbackBench::joinRoom(Server *server)
+{
+    return waitFor(server, &Server::joinedRoom, [ = ]
+    {
+        QMetaObject::invokeMethod(server, "joinRoom",
+                                  Q_ARG(QByteArray, id_room));
+    });
+}
+
+QString LoopbackBench::createFile(qint64 size)
+{
+    auto path = dir.filePath(QString::number(size));
+
+    QFile file(path);
+
+    if (!file.exists() && file.open(QIODevice::WriteOnly))
+    {
+        // Random content, so compression can't flatter the numbers
+        QVector<quint32> data(int(size / sizeof(quint32)));
+        QRandomGenerator::global()->fillRange(data.data(), data.size());
+
+        file.write(reinterpret_cast<const char *>(data.constData()), size);
+    }
+
+    return path;
+}
+
+QByteArray LoopbackBench::sendFile(Server *server, const QString &path, qint64 size)
+{
+    QSharedPointer<File> file(new File(path));
+
+    if (!file->open(QIODevice::ReadOnly))
+    {
+        return {};
+    }
+
+    QByteArray id;
+
+    auto send = [ = ]
+    {
+        QMetaObject::invokeMethod(server, "sendFile",
+                                  Q_ARG(QSharedPointer<File>, file));
+    };
+
+    if (!waitForTransfer(server, id, size, send))
+    {
+        return {};
+    }
+
+    return id;
+}
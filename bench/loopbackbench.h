@@ -0,0 +1,46 @@
+#ifndef LOOPBACKBENCH_H
+#define LOOPBACKBENCH_H
+
+#include <QObject>
+#include <QTemporaryDir>
+
+class MockServer;
+class Server;
+
+// End-to-end measurements through the real Server and File classes against
+// the mock server on the loopback interface
+class LoopbackBench : public QObject
+{
+    Q_OBJECT
+public:
+    explicit LoopbackBench();
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void handshake();
+    void suites_data();
+    void suites();
+    void resumption();
+    void roundTrip();
+    void upload_data();
+    void upload();
+    void concurrentUploads();
+    void download_data();
+    void download();
+
+private:
+    MockServer *mock;
+    QByteArray id_room;
+    int users;
+    QTemporaryDir dir;
+
+    Server *connectUser(MockServer * = nullptr);
+    void disconnectUser(Server *);
+    bool joinRoom(Server *);
+    QString createFile(qint64);
+    QByteArray sendFile(Server *, const QString &, qint64);
+};
+
+#endif // LOOPBACKBENCH_H
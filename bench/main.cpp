@@ -0,0 +1,90 @@
+#include "chatbrowserbench.h"
+#include "cipherbench.h"
+#include "codecbench.h"
+#include "compressionbench.h"
+#include "encodingbench.h"
+#include "filebench.h"
+#include "handshakebench.h"
+#include "packetbench.h"
+
+#include <QApplication>
+#include <QFileInfo>
+#include <QTest>
+
+// Every object writes to a file of its own, QTest would overwrite a shared
+// one: "-o results.xml,xml" becomes results-CodecBench.xml and so on
+static QStringList arguments(const QStringList &arguments, const QObject &object)
+{
+    auto result = arguments;
+
+    for (int i = 1; i + 1 < result.size(); i++)
+    {
+        if (result[i] != "-o")
+        {
+            continue;
+        }
+
+        auto output = result[++i];
+        auto comma = output.lastIndexOf(',');
+        auto name = comma < 0 ? output : output.left(comma);
+        auto format = comma < 0 ? QString() : output.mid(comma);
+
+        if (name == "-")
+        {
+            continue;
+        }
+
+        QFileInfo info(name);
+        auto suffix = info.completeSuffix();
+
+        result[i] = QString("%1/%2-%3%4%5")
+                    .arg(info.path(),
+                         info.baseName(),
+                         object.metaObject()->className(),
+                         suffix.isEmpty() ? QString() : "." + suffix,
+                         format);
+    }
+
+    return result;
+}
+
+int main(int argc, char *argv[])
+{
+    // ChatBrowser needs a QApplication, not a display
+    if (!qEnvironmentVariableIsSet("QT_QPA_PLATFORM"))
+    {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+
+    QApplication a(argc, argv);
+
+    HandshakeBench handshake;
+    CipherBench cipher;
+    PacketBench packet;
+    CodecBench codec;
+    EncodingBench encoding;
+    CompressionBench compression;
+    FileBench file;
+    ChatBrowserBench chatBrowser;
+
+    const QList<QObject *> benchmarks =
+    {
+        &handshake,
+        &cipher,
+        &packet,
+        &codec,
+        &encoding,
+        &compression,
+        &file,
+        &chatBrowser
+    };
+
+    int status = 0;
+
+    for (auto benchmark : benchmarks)
+    {
+        status |= QTest::qExec(benchmark, arguments(a.arguments(), *benchmark));
+    }
+
+    return status;
+}
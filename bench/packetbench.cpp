@@ -0,0 +1,219 @@
+#include "packetbench.h"
+#include "core/packet.h"
+
+#include <QBuffer>
+#include <QDataStream>
+#include <QDateTime>
+#include <QTest>
+#include <QUuid>
+
+#include <functional>
+
+// One structure filled the way it typically is on the wire
+struct Sample
+{
+    const char *name;
+    std::function<bool(bool)> run;
+};
+
+template <typename Stream, typename T>
+static bool roundTrip(const T &d)
+{
+    QByteArray data;
+    QBuffer buffer(&data);
+
+    buffer.open(QIODevice::WriteOnly);
+    Stream out(&buffer);
+    out << d;
+    buffer.close();
+
+    buffer.open(QIODevice::ReadOnly);
+    Stream in(&buffer);
+    T r;
+    in >> r;
+
+    return in.status() == Stream::Ok;
+}
+
+template <typename T>
+static Sample sample(const char *name, const T &d)
+{
+    return
+    {
+        name,
+        [d](bool compact)
+        {
+            return compact
+                   ? roundTrip<CompactStream>(d)
+                   : roundTrip<QDataStream>(d);
+        }
+    };
+}
+
+static QByteArray id()
+{
+    return QUuid::createUuid().toRfc4122();
+}
+
+static Message message()
+{
+    return
+    {
+        QDateTime::currentSecsSinceEpoch(),
+        id(),
+        "username",
+        "The quick brown fox jumps over the lazy dog"
+    };
+}
+
+static const QVector<Sample> &samples()
+{
+    // Key and signature sizes are the ones of Kyber768 and Dilithium3
+    static const Capabilities capabilities
+    {
+        Capabilities::Compact,
+        Capabilities::LargeFrames | Capabilities::SessionKeys,
+        1 << 20
+    };
+    static const Suite suite
+    {
+        Suite::Kyber768,
+        Suite::Dilithium3,
+        1u << Suite::Kyber768
+    };
+    static const QVector<Sample> samples =
+    {
+        sample("Capabilities", capabilities),
+        sample("Suite", suite),
+        sample("ServerKeyExchange", ServerKeyExchange
+        {
+            {QVector<quint8>(1952, 1), QVector<quint8>(1184, 2)},
+            QVector<quint8>(3293, 3),
+            capabilities,
+            suite
+        }),
+        sample("ClientKeyExchange", ClientKeyExchange
+        {
+            QVector<quint8>(1088, 1),
+            capabilities,
+            {},
+            {},
+            suite
+        }),
+        sample("ReResumption", ReResumption
+        {
+            ReResumption::Accepted
+        }),
+        sample("SessionTicket", SessionTicket
+        {
+            QByteArray(88, 'x'),
+            24 * 60 * 60
+        }),
+        sample("RtAuthorization", RtAuthorization
+        {
+            "username",
+            "password",
+            RtAuthorization::Signin
+        }),
+        sample("ReAuthorization", ReAuthorization
+        {
+            ReAuthorization::Authorized,
+            ReAuthorization::NoError
+        }),
+        sample("Room", Room
+        {
+            id(),
+            "General"
+        }),
+        sample("Established", Established
+        {
+            "Server",
+            "Welcome",
+            QVector<Room>(10, {id(), "General"})
+        }),
+        sample("Synchronize", Synchronize
+        {
+            id(),
+            id(),
+            100
+        }),
+        sample("UserState", UserState
+        {
+            id(),
+            UserState::Joined
+        }),
+        sample("Message", message()),
+        sample("MessageBatch", MessageBatch
+        {
+            QVector<Message>(100, message()),
+            id()
+        }),
+        sample("RtRoom", RtRoom
+        {
+            id(),
+            RtRoom::Join
+        }),
+        sample("ReRoom", ReRoom
+        {
+            ReRoom::Joined
+        }),
+        sample("RtUpload", RtUpload
+        {
+            id(),
+            1 << 30,
+            RtUpload::Transmit
+        }),
+        sample("ReUpload", ReUpload
+        {
+            id(),
+            ReUpload::ReadyWrite,
+            ReUpload::NoError
+        }),
+        sample("Upload", Upload
+        {
+            id(),
+            QByteArray(32768, 'x')
+        }),
+        sample("UploadState", UploadState
+        {
+            id(),
+            UploadState::Next
+        }),
+        sample("Ping", Ping
+        {
+            QDateTime::currentMSecsSinceEpoch()
+        })
+    };
+
+    return samples;
+}
+
+PacketBench::PacketBench()
+{
+}
+
+// One iteration serializes and deserializes the structure once
+void PacketBench::roundTrip_data()
+{
+    QTest::addColumn<int>("index");
+    QTest::addColumn<bool>("compact");
+
+    for (int i = 0; i < samples().size(); i++)
+    {
+        QTest::newRow(qPrintable(QString("%1 legacy").arg(samples()[i].name))) << i << false;
+        QTest::newRow(qPrintable(QString("%1 compact").arg(samples()[i].name))) << i << true;
+    }
+}
+
+void PacketBench::roundTrip()
+{
+    QFETCH(int, index);
+    QFETCH(bool, compact);
+
+    const auto &run = samples()[index].run;
+
+    QBENCHMARK
+    {
+        QVERIFY(run(compact));
+    }
+}
@@ -0,0 +1,18 @@
+#ifndef PACKETBENCH_H
+#define PACKETBENCH_H
+
+#include <QObject>
+
+// Serialization of every structure in packet.h with both encodings
+class PacketBench : public QObject
+{
+    Q_OBJECT
+public:
+    explicit PacketBench();
+
+private slots:
+    void roundTrip_data();
+    void roundTrip();
+};
+
+#endif // PACKETBENCH_H
@@ -0,0 +1,101 @@
+#include "mockserver.h"
+#include "core/pqcrypto.h"
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDebug>
+
+int main(int argc, char *argv[])
+{
+    qRegisterMetaType<QAbstractSocket::SocketError>("SocketError");
+
+    QCoreApplication a(argc, argv);
+    a.setApplicationName("neutron-mockserver");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Local stand-in for a neutron server");
+    parser.addHelpOption();
+    parser.addOptions(
+    {
+        {{"p", "port"}, "Port to listen on, any free one by default.", "port", "0"},
+        {{"n", "name"}, "Server name.", "name", "Mock server"},
+        {{"m", "motd"}, "Welcome message.", "motd"},
+        {{"r", "room"}, "Room to create, may be repeated.", "room"},
+        {{"t", "ticket-lifetime"}, "Seconds a resumption ticket stays valid.", "seconds", "86400"},
+        {{"k", "kem"}, "Key encapsulation proposed to clients, by liboqs name.", "name"},
+        {{"s", "signature"}, "Signature algorithm of the server identity, by liboqs name.", "name"},
+        {"legacy", "Offer no protocol extensions."}
+    });
+    parser.process(a);
+
+    auto signature = Suite::Picnic2L5;
+
+    if (parser.isSet("signature") && !DigitalSignature::fromName(parser.value("signature"), signature))
+    {
+        qCritical().noquote() << "Unknown signature algorithm" << parser.value("signature");
+        return EXIT_FAILURE;
+    }
+
+    // Legacy clients only know the original suite
+    if (parser.isSet("legacy") && signature != Suite::Picnic2L5)
+    {
+        qCritical().noquote() << "A legacy server signs with"
+                              << DigitalSignature::getName(Suite::Picnic2L5);
+        return EXIT_FAILURE;
+    }
+
+    if (!DigitalSignature(signature).isAvailable())
+    {
+        qCritical().noquote() << "Signature algorithm not available"
+                              << DigitalSignature::getName(signature);
+        return EXIT_FAILURE;
+    }
+
+    MockServer server(signature);
+
+    if (parser.isSet("kem"))
+    {
+        auto kem = Suite::SikeP751;
+
+        if (!KeyEncapsulation::fromName(parser.value("kem"), kem) || !server.setKem(kem))
+        {
+            qCritical().noquote() << "Key encapsulation not available" << parser.value("kem");
+            return EXIT_FAILURE;
+        }
+    }
+
+    server.setName(parser.value("name"));
+    server.setMotd(parser.value("motd"));
+    server.setTicketLifetime(parser.value("ticket-lifetime").toLongLong());
+
+    auto rooms = parser.values("room");
+
+    if (rooms.isEmpty())
+    {
+        rooms.append("General");
+    }
+
+    for (const auto &room : rooms)
+    {
+        server.addRoom(room);
+    }
+
+    if (parser.isSet("legacy"))
+    {
+        server.setCapabilities({});
+    }
+
+    if (!server.listen(QHostAddress::LocalHost, quint16(parser.value("port").toUInt())))
+    {
+        qCritical().noquote() << server.errorString();
+        return EXIT_FAILURE;
+    }
+
+    qInfo().noquote() << "Listening on port" << server.serverPort();
+    qInfo().noquote() << "Server id" << server.getId().toHex();
+    qInfo().noquote() << "Suite"
+                      << KeyEncapsulation::getName(server.getSuite().kem)
+                      << DigitalSignature::getName(server.getSuite().signature);
+
+    return QCoreApplication::exec();
+}
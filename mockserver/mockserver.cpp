@@ -0,0 +1,411 @@
+#include "mockserver.h"
+#include "session.h"
+#include "core/transport.h"
+
+#include <QDateTime>
+#include <QtEndian>
+#include <QUuid>
+
+#include <algorithm>
+
+#include <cryptopp/blake2.h>
+#include <cryptopp/filters.h>
+#include <cryptopp/sha3.h>
+using CryptoPP::ArraySink;
+using CryptoPP::ArraySource;
+using CryptoPP::HashFilter;
+using CryptoPP::SHA3_512;
+
+// Tickets may be redeemed for a day by default
+static constexpr qint64 DEFAULT_TICKET_LIFETIME = 24 * 60 * 60;
+
+MockServer::MockServer(Suite::Signature signature, QObject *parent)
+    : QTcpServer(parent)
+    , signature(signature)
+    , signer(signature)
+    , kem(Suite::SikeP751)
+    , kems(0)
+    , ticket_key(32)
+    , ticketLifetime(DEFAULT_TICKET_LIFETIME)
+    , name("Mock server")
+{
+    // Everything the client knows of is offered unless told otherwise
+    capabilities.encoding = Capabilities::Compact;
+    capabilities.features = Capabilities::LargeFrames
+                            | Capabilities::Compression
+                            | Capabilities::MessageBatches
+                            | Capabilities::PagedHistory
+                            | Capabilities::SessionKeys
+                            | Capabilities::Resumption
+                            | Capabilities::AesGcm
+                            | Capabilities::Windowed
+                            | Capabilities::AdaptiveChunks
+                            | Capabilities::ResumableTransfers
+                            | Capabilities::Digests;
+    capabilities.max_frame_size = Transport::MAX_FRAME_SIZE;
+
+    // Every locally available KEM is accepted, the legacy one is proposed
+    const auto available = KeyEncapsulation::available();
+
+    for (auto candidate : available)
+    {
+        kems |= 1u << candidate;
+    }
+
+    if (!available.isEmpty() && !available.contains(kem))
+    {
+        kem = available.first();
+    }
+
+    if (!signer.generate(public_key, secret_key))
+    {
+        qFatal("Failed to generate the signature key pair");
+    }
+
+    // Clients identify the server by the hash of its signature public key
+    SHA3_512 hash;
+    id.resize(hash.DigestSize());
+
+    ArraySource(public_key.constData(),
+                public_key.size(), true,
+                new HashFilter(
+                    hash,
+                    new ArraySink(reinterpret_cast<quint8 *>(id.data()), id.size())
+                ));
+
+    // Tickets issued by an earlier run of the process are never accepted
+    rng.GenerateBlock(ticket_key.data(), size_t(ticket_key.size()));
+
+    pipelineThread.start();
+
+    connect(this, &QTcpServer::newConnection,
+            this, &MockServer::onNewConnection);
+}
+
+MockServer::~MockServer()
+{
+    // Their transports still hand work to the pipeline thread, which as a
+    // member is gone before ~QObject gets to the children
+    qDeleteAll(findChildren<Session *>(QString(), Qt::FindDirectChildrenOnly));
+    sessions.clear();
+
+    pipelineThread.quit();
+    pipelineThread.wait();
+}
+
+const QByteArray &MockServer::getId() const
+{
+    return id;
+}
+
+const Capabilities &MockServer::getCapabilities() const
+{
+    return capabilities;
+}
+
+const QVector<quint8> &MockServer::getPublicKey() const
+{
+    return public_key;
+}
+
+const QVector<quint8> &MockServer::getSecretKey() const
+{
+    return secret_key;
+}
+
+const DigitalSignature &MockServer::getSigner() const
+{
+    return signer;
+}
+
+Suite MockServer::getSuite() const
+{
+    // Legacy clients know of a single suite, which is implied
+    if (capabilities.encoding == Capabilities::Absent)
+    {
+        return {Suite::SikeP751, Suite::Picnic2L5, 1u << Suite::SikeP751};
+    }
+
+    return {kem, signature, kems};
+}
+
+QThread *MockServer::getPipelineThread()
+{
+    return &pipelineThread;
+}
+
+Established MockServer::getEstablished() const
+{
+    return
+    {
+        name,
+        motd,
+        rooms
+    };
+}
+
+qint64 MockServer::getTicketLifetime() const
+{
+    return ticketLifetime;
+}
+
+void MockServer::setCapabilities(const Capabilities &capabilities)
+{
+    this->capabilities = capabilities;
+}
+
+bool MockServer::setKem(Suite::Kem kem)
+{
+    if (!(kems & (1u << kem)))
+    {
+        return false;
+    }
+
+    this->kem = kem;
+    return true;
+}
+
+void MockServer::setName(const QString &name)
+{
+    this->name = name;
+}
+
+void MockServer::setMotd(const QString &motd)
+{
+    this->motd = motd;
+}
+
+void MockServer::setTicketLifetime(qint64 lifetime)
+{
+    ticketLifetime = lifetime;
+}
+
+void MockServer::addRoom(const QString &name)
+{
+    auto id = QUuid::createUuid().toRfc4122();
+
+    rooms.append(
+    {
+        id,
+        name
+    });
+    history.insert(id, {});
+}
+
+ReAuthorization::Error MockServer::authorize(const RtAuthorization &d)
+{
+    auto username = QString::fromUtf8(d.username);
+
+    if (username.isEmpty())
+    {
+        return ReAuthorization::InvalidUsername;
+    }
+
+    switch (d.request)
+    {
+    case RtAuthorization::Signup:
+    {
+        if (users.contains(username))
+        {
+            return ReAuthorization::UserExists;
+        }
+
+        users.insert(username, d.password);
+    }
+    break;
+
+    case RtAuthorization::Signin:
+    {
+        if (!users.contains(username))
+        {
+            return ReAuthorization::InvalidUsername;
+        }
+
+        if (users.value(username) != d.password)
+        {
+            return ReAuthorization::InvalidPassword;
+        }
+    }
+    break;
+    }
+
+    return ReAuthorization::NoError;
+}
+
+// The ticket is the resumption secret and its expiry sealed with a key only
+// this server knows: IV, tag, then the ciphertext
+QByteArray MockServer::issueTicket(const QVector<quint8> &secret)
+{
+    QByteArray ticket(int(enc.DefaultIVLength() + enc.DigestSize() + sizeof(qint64)) + secret.size(), '\0');
+
+    auto iv = reinterpret_cast<quint8 *>(ticket.data());
+    auto tag = iv + enc.DefaultIVLength();
+    auto data = tag + enc.DigestSize();
+
+    qToBigEndian(QDateTime::currentSecsSinceEpoch() + ticketLifetime, data);
+    std::copy(secret.begin(), secret.end(), data + sizeof(qint64));
+
+    enc.GetNextIV(rng, iv);
+    enc.SetKeyWithIV(ticket_key.constData(),
+                     ticket_key.size(),
+                     iv,
+                     enc.DefaultIVLength());
+    enc.EncryptAndAuthenticate(data,
+                               tag,
+                               enc.DigestSize(),
+                               iv,
+                               enc.DefaultIVLength(),
+                               nullptr,
+                               0,
+                               data, sizeof(qint64) + size_t(secret.size()));
+
+    return ticket;
+}
+
+bool MockServer::redeemTicket(const QByteArray &ticket, QVector<quint8> &secret)
+{
+    auto overhead = int(dec.DefaultIVLength() + dec.DigestSize() + sizeof(qint64));
+
+    if (ticket.size() <= overhead)
+    {
+        return false;
+    }
+
+    auto sealed = ticket;
+
+    auto iv = reinterpret_cast<quint8 *>(sealed.data());
+    auto tag = iv + dec.DefaultIVLength();
+    auto data = tag + dec.DigestSize();
+    auto length = size_t(sealed.size() - overhead) + sizeof(qint64);
+
+    dec.SetKeyWithIV(ticket_key.constData(),
+                     ticket_key.size(),
+                     iv,
+                     dec.DefaultIVLength());
+
+    if (!dec.DecryptAndVerify(data,
+                              tag,
+                              dec.DigestSize(),
+                              iv,
+                              dec.DefaultIVLength(),
+                              nullptr,
+                              0,
+                              data, length)
+            || qFromBigEndian<qint64>(data) <= QDateTime::currentSecsSinceEpoch())
+    {
+        return false;
+    }
+
+    secret = QVector<quint8>(data + sizeof(qint64), data + length);
+    return true;
+}
+
+bool MockServer::isRoomExists(const QByteArray &id) const
+{
+    return history.contains(id);
+}
+
+QVector<QByteArray> MockServer::getParticipants(const QByteArray &id, const Session *except) const
+{
+    QVector<QByteArray> participants;
+
+    for (auto session : sessions)
+    {
+        if (session != except && session->getRoom() == id)
+        {
+            participants.append(session->getUsername().toUtf8());
+        }
+    }
+
+    return participants;
+}
+
+void MockServer::post(const QByteArray &id, const Session *sender, Message d)
+{
+    d.timestamp = QDateTime::currentSecsSinceEpoch();
+    d.id_sender = sender->getUsername();
+
+    history[id].append(d);
+
+    for (auto session : sessions)
+    {
+        if (session != sender && session->getRoom() == id)
+        {
+            session->deliver(d);
+        }
+    }
+}
+
+QVector<Message> MockServer::getHistory(const QByteArray &id) const
+{
+    return history.value(id);
+}
+
+void MockServer::announce(const QByteArray &id, const Session *subject, UserState::State state)
+{
+    for (auto session : sessions)
+    {
+        if (session != subject && session->getRoom() == id)
+        {
+            session->announce(
+            {
+                subject->getUsername().toUtf8(),
+                state
+            });
+        }
+    }
+}
+
+bool MockServer::isFileExists(const QByteArray &id) const
+{
+    return files.contains(id);
+}
+
+QByteArray MockServer::getFile(const QByteArray &id) const
+{
+    return files.value(id);
+}
+
+QByteArray MockServer::getDigest(const QByteArray &id) const
+{
+    return digests.value(id);
+}
+
+void MockServer::storeFile(const QByteArray &id, const QByteArray &data)
+{
+    CryptoPP::BLAKE2b hash;
+
+    QByteArray digest(int(hash.DigestSize()), Qt::Uninitialized);
+    hash.CalculateDigest(reinterpret_cast<quint8 *>(digest.data()),
+                         reinterpret_cast<const quint8 *>(data.constData()),
+                         size_t(data.size()));
+
+    files.insert(id, data);
+    digests.insert(id, digest);
+}
+
+void MockServer::storePartial(const QByteArray &id, const QByteArray &data)
+{
+    partials.insert(id, data);
+}
+
+QByteArray MockServer::takePartial(const QByteArray &id)
+{
+    return partials.take(id);
+}
+
+void MockServer::onNewConnection()
+{
+    while (hasPendingConnections())
+    {
+        auto session = new Session(nextPendingConnection(), this);
+
+        sessions.insert(session);
+
+        // Sessions may close while another one is being broadcast to
+        connect(session, &Session::closed, this, [ = ]
+        {
+            sessions.remove(session);
+        }, Qt::QueuedConnection);
+    }
+}
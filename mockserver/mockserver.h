@@ -0,0 +1,101 @@
+#ifndef MOCKSERVER_H
+#define MOCKSERVER_H
+
+#include "core/packet.h"
+#include "core/pqcrypto.h"
+
+#include <QHash>
+#include <QSet>
+#include <QTcpServer>
+#include <QThread>
+
+#include <cryptopp/chachapoly.h>
+#include <cryptopp/osrng.h>
+
+class Session;
+
+// In-memory stand-in for a neutron server.
+//
+// Users, rooms, history and files live only as long as the process, which is
+// all the client needs to be exercised and benchmarked without a network.
+class MockServer : public QTcpServer
+{
+    Q_OBJECT
+public:
+    explicit MockServer(Suite::Signature = Suite::Picnic2L5, QObject * = nullptr);
+    ~MockServer();
+
+    const QByteArray &getId() const;
+    const Capabilities &getCapabilities() const;
+    const QVector<quint8> &getPublicKey() const;
+    const QVector<quint8> &getSecretKey() const;
+    const DigitalSignature &getSigner() const;
+    Suite getSuite() const;
+    QThread *getPipelineThread();
+    Established getEstablished() const;
+    qint64 getTicketLifetime() const;
+
+    void setCapabilities(const Capabilities &);
+    bool setKem(Suite::Kem);
+    void setName(const QString &);
+    void setMotd(const QString &);
+    void setTicketLifetime(qint64);
+    void addRoom(const QString &);
+
+    ReAuthorization::Error authorize(const RtAuthorization &);
+
+    QByteArray issueTicket(const QVector<quint8> &);
+    bool redeemTicket(const QByteArray &, QVector<quint8> &);
+
+    bool isRoomExists(const QByteArray &) const;
+    QVector<QByteArray> getParticipants(const QByteArray &, const Session *) const;
+
+    void post(const QByteArray &, const Session *, Message);
+    QVector<Message> getHistory(const QByteArray &) const;
+
+    void announce(const QByteArray &, const Session *, UserState::State);
+
+    bool isFileExists(const QByteArray &) const;
+    QByteArray getFile(const QByteArray &) const;
+    QByteArray getDigest(const QByteArray &) const;
+    void storeFile(const QByteArray &, const QByteArray &);
+    void storePartial(const QByteArray &, const QByteArray &);
+    QByteArray takePartial(const QByteArray &);
+
+private slots:
+    void onNewConnection();
+
+private:
+    Suite::Signature signature;
+    DigitalSignature signer;
+    Suite::Kem kem;
+    quint32 kems;
+
+    QByteArray id;
+    QVector<quint8> public_key;
+    QVector<quint8> secret_key;
+
+    QVector<quint8> ticket_key;
+    qint64 ticketLifetime;
+
+    CryptoPP::AutoSeededRandomPool rng;
+    CryptoPP::XChaCha20Poly1305::Encryption enc;
+    CryptoPP::XChaCha20Poly1305::Decryption dec;
+
+    Capabilities capabilities;
+    QString name;
+    QString motd;
+    QVector<Room> rooms;
+
+    QHash<QString, QByteArray> users;
+    QHash<QByteArray, QVector<Message>> history;
+    QHash<QByteArray, QByteArray> files;
+    QHash<QByteArray, QByteArray> digests;
+    // Uploads interrupted by a disconnect, until resumed
+    QHash<QByteArray, QByteArray> partials;
+    QSet<Session *> sessions;
+
+    QThread pipelineThread;
+};
+
+#endif // MOCKSERVER_H
@@ -0,0 +1,916 @@
+#include "session.h"
+#include "mockserver.h"
+#include "core/keyschedule.h"
+#include "core/pqcrypto.h"
+
+#include <QDateTime>
+#include <QDebug>
+#include <QHostAddress>
+
+#include <type_traits>
+
+// Same chunking rule as the client, so transfers take the same number of frames
+static constexpr qint64 PAGE_SIZE = 32768;
+static constexpr qint64 UPLOAD_OVERHEAD = 256;
+// Payloads shorter than this, or compressing by fewer bytes, are sent as is
+static constexpr qint64 COMPRESSION_THRESHOLD = 64;
+// Messages per MessageBatch when synchronizing without paging
+static constexpr int HISTORY_BATCH_SIZE = 100;
+// Largest page handed out, whatever the client asks for
+static constexpr quint32 MAX_HISTORY_PAGE_SIZE = 1000;
+// Files are kept in memory
+static constexpr qint64 MAX_FILE_SIZE = 1 << 30;
+static constexpr qint64 ID_SIZE = 16;
+static constexpr int PING_INTERVAL = 15000;
+
+Session::Session(QTcpSocket *socket, MockServer *server)
+    : QObject(server)
+    , socket(socket)
+    , server(server)
+    , authorized(false)
+    , batches(false)
+    , windowed(false)
+    , adaptiveChunks(false)
+    , resumable(false)
+    , digests(false)
+    , resumptionAttempted(false)
+    , retried(false)
+    , chunkSize(PAGE_SIZE)
+{
+    socket->setParent(this);
+    socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+
+    transport = new Transport(this);
+    transport->setSocket(socket);
+    transport->setPipelineThread(server->getPipelineThread());
+
+    connect(socket, &QTcpSocket::disconnected,
+            this, &Session::onDisconnected);
+    connect(socket, &QTcpSocket::readyRead,
+            this, &Session::onReadyRead);
+    connect(transport, &Transport::readyRead,
+            this, &Session::onReadyRead);
+
+    flushTimer = new QTimer(this);
+    flushTimer->callOnTimeout(this, &Session::flush);
+    flushTimer->setInterval(0);
+    flushTimer->setSingleShot(true);
+
+    pingTimer = new QTimer(this);
+    pingTimer->callOnTimeout([ = ]
+    {
+        sendOne<PacketType::Ping>(
+                    Ping
+        {
+            QDateTime::currentMSecsSinceEpoch()
+        });
+    });
+    pingTimer->setInterval(PING_INTERVAL);
+
+    offer(server->getSuite().kem);
+}
+
+const QString &Session::getUsername() const
+{
+    return username;
+}
+
+const QByteArray &Session::getRoom() const
+{
+    return id_room;
+}
+
+void Session::deliver(const Message &d)
+{
+    sendOne<PacketType::Message>(d);
+}
+
+void Session::announce(const UserState &d)
+{
+    sendOne<PacketType::UserState>(d);
+}
+
+void Session::offer(Suite::Kem kem)
+{
+    suite = server->getSuite();
+    suite.kem = kem;
+
+    if (!KeyEncapsulation(kem).generate(public_key, secret_key))
+    {
+        close("Failed to generate an ephemeral key pair");
+        return;
+    }
+
+    QVector<quint8> signature;
+
+    if (!server->getSigner().sign(DigitalSignature::content(suite, public_key),
+                                  server->getSecretKey(),
+                                  signature))
+    {
+        close("Failed to sign the ephemeral public key");
+        return;
+    }
+
+    sendOne<PacketType::Handshake>(
+                ServerKeyExchange
+    {
+        {server->getPublicKey(), public_key},
+        signature,
+        server->getCapabilities(),
+        suite
+    });
+}
+
+void Session::close(const QString &reason)
+{
+    if (!reason.isEmpty())
+    {
+        qWarning().noquote() << socket->peerAddress().toString()
+                             << socket->peerPort()
+                             << reason;
+    }
+
+    flush();
+    socket->close();
+}
+
+void Session::onDisconnected()
+{
+    leave();
+
+    // Interrupted uploads can be resumed by the next session
+    if (resumable)
+    {
+        for (auto i = transfers.cbegin(); i != transfers.cend(); ++i)
+        {
+            if (i->incoming && i->offset && i->offset < i->size)
+            {
+                server->storePartial(i.key(), i->data);
+            }
+        }
+    }
+
+    transfers.clear();
+
+    emit closed();
+    deleteLater();
+}
+
+void Session::onReadyRead()
+{
+    // Frames may be waiting from the pipeline before anything is received
+    do
+    {
+        quint8 type;
+        auto status = Transport::Incomplete;
+
+        while (socket->isOpen()
+                && (status = transport->next(type)) == Transport::Ok)
+        {
+            if (!handle(type))
+            {
+                close("Failed to deserialize incoming packet");
+                break;
+            }
+        }
+
+        if (status == Transport::Error)
+        {
+            close(transport->getError());
+            break;
+        }
+    }
+    while (socket->isOpen() && transport->receive());
+}
+
+bool Session::handle(quint8 type)
+{
+    bool ok = true;
+
+    if (!transport->isEncrypted())
+    {
+        switch (type)
+        {
+        case quint8(PacketType::Handshake):
+        {
+            ok = dispatch<PacketType::Handshake>(&Session::doHandshake);
+        }
+        break;
+        }
+    }
+    else if (!authorized)
+    {
+        switch (type)
+        {
+        case quint8(PacketType::RtAuthorization):
+        {
+            ok = dispatch<PacketType::RtAuthorization>(&Session::doRtAuthorization);
+        }
+        break;
+        }
+    }
+    else
+    {
+        switch (type)
+        {
+        case quint8(PacketType::Synchronize):
+        {
+            ok = dispatch<PacketType::Synchronize>(&Session::doSynchronize);
+        }
+        break;
+
+        case quint8(PacketType::Message):
+        {
+            ok = dispatch<PacketType::Message>(&Session::doMessage);
+        }
+        break;
+
+        case quint8(PacketType::RtRoom):
+        {
+            ok = dispatch<PacketType::RtRoom>(&Session::doRtRoom);
+        }
+        break;
+
+        case quint8(PacketType::RtUpload):
+        {
+            ok = dispatch<PacketType::RtUpload>(&Session::doRtUpload);
+        }
+        break;
+
+        case quint8(PacketType::Upload):
+        {
+            ok = dispatch<PacketType::Upload>(&Session::doUpload);
+        }
+        break;
+
+        case quint8(PacketType::UploadState):
+        {
+            ok = dispatch<PacketType::UploadState>(&Session::doUploadState);
+        }
+        break;
+
+        case quint8(PacketType::Pong):
+        {
+            ok = dispatch<PacketType::Pong>(&Session::doPong);
+        }
+        break;
+        }
+    }
+
+    return ok;
+}
+
+void Session::doHandshake(ClientKeyExchange d)
+{
+    const auto &offered = server->getCapabilities();
+
+    if (offered.encoding == Capabilities::Absent)
+    {
+        d.capabilities = {};
+        d.ticket.clear();
+    }
+
+    if (d.capabilities.encoding > offered.encoding
+            || (d.capabilities.features & ~offered.features)
+            || ((d.capabilities.features & Capabilities::AesGcm)
+                && !(d.capabilities.features & Capabilities::SessionKeys))
+            || ((d.capabilities.features & Capabilities::AdaptiveChunks)
+                && !(d.capabilities.features & Capabilities::Windowed)))
+    {
+        close("Client selected capabilities that were not offered");
+        return;
+    }
+
+    // Neither a ticket nor a ciphertext, the client asks for another KEM
+    if (d.ticket.isEmpty() && d.ciphertext.isEmpty())
+    {
+        if (retried
+                || d.capabilities.encoding == Capabilities::Absent
+                || d.suite.signature != suite.signature
+                || d.suite.kem == suite.kem
+                || !(suite.kems & (1u << d.suite.kem)))
+        {
+            close("Client requested an invalid suite");
+            return;
+        }
+
+        retried = true;
+        offer(d.suite.kem);
+        return;
+    }
+
+    QVector<quint8> shared_secret;
+
+    if (!d.ticket.isEmpty())
+    {
+        // One attempt per connection, the fallback is the full key exchange
+        if (resumptionAttempted
+                || !(d.capabilities.features & Capabilities::Resumption)
+                || !d.ciphertext.isEmpty()
+                || d.nonce.size() != KeySchedule::NONCE_SIZE)
+        {
+            close("Client sent invalid data");
+            return;
+        }
+
+        resumptionAttempted = true;
+
+        QVector<quint8> secret;
+
+        if (!server->redeemTicket(d.ticket, secret))
+        {
+            sendOne<PacketType::Resumption>(
+                        ReResumption
+            {
+                ReResumption::Rejected
+            });
+            return;
+        }
+
+        sendOne<PacketType::Resumption>(
+                    ReResumption
+        {
+            ReResumption::Accepted
+        });
+
+        shared_secret = KeySchedule::resumedSecret(secret, d.nonce, server->getId(), public_key);
+    }
+    else
+    {
+        if (!KeyEncapsulation(suite.kem).decapsulate(d.ciphertext, secret_key, shared_secret))
+        {
+            close("Failed to reach shared secret");
+            return;
+        }
+    }
+
+    secret_key.clear();
+
+    // The frame carrying the key exchange is the last one in the original framing
+    if (d.capabilities.features & Capabilities::SessionKeys)
+    {
+        transport->setSessionKeys(shared_secret,
+                                  SessionCipher::Server,
+                                  d.capabilities.features & Capabilities::AesGcm
+                                  ? SessionCipher::Aes256Gcm
+                                  : SessionCipher::ChaCha20Poly1305);
+    }
+    else
+    {
+        transport->setSecret(shared_secret);
+    }
+
+    if (d.capabilities.encoding != Capabilities::Absent)
+    {
+        transport->setEncoding(d.capabilities.encoding);
+    }
+
+    if (d.capabilities.features & Capabilities::LargeFrames)
+    {
+        if (d.capabilities.max_frame_size < Transport::LEGACY_FRAME_SIZE
+                || d.capabilities.max_frame_size > offered.max_frame_size)
+        {
+            close("Client selected an invalid frame size");
+            return;
+        }
+
+        transport->setMaxFrameSize(d.capabilities.max_frame_size);
+        chunkSize = qMax(PAGE_SIZE,
+                         (d.capabilities.max_frame_size - UPLOAD_OVERHEAD) / PAGE_SIZE * PAGE_SIZE);
+    }
+
+    if (d.capabilities.features & Capabilities::Compression)
+    {
+        transport->setCompressionThreshold(COMPRESSION_THRESHOLD);
+    }
+
+    if (d.capabilities.features & Capabilities::Resumption)
+    {
+        resumption_secret = KeySchedule::resumptionSecret(shared_secret);
+    }
+
+    batches = d.capabilities.features & Capabilities::MessageBatches;
+    windowed = d.capabilities.features & Capabilities::Windowed;
+    adaptiveChunks = d.capabilities.features & Capabilities::AdaptiveChunks;
+    resumable = d.capabilities.features & Capabilities::ResumableTransfers;
+    digests = d.capabilities.features & Capabilities::Digests;
+}
+
+void Session::doRtAuthorization(RtAuthorization d)
+{
+    auto error = server->authorize(d);
+
+    if (error != ReAuthorization::NoError)
+    {
+        sendOne<PacketType::ReAuthorization>(
+                    ReAuthorization
+        {
+            ReAuthorization::ErrorOccurred,
+            error
+        });
+        return;
+    }
+
+    authorized = true;
+    username = QString::fromUtf8(d.username);
+
+    pingTimer->start();
+
+    sendOne<PacketType::ReAuthorization>(
+                ReAuthorization
+    {
+        ReAuthorization::Authorized,
+        ReAuthorization::NoError
+    });
+    sendOne<PacketType::Established>(server->getEstablished());
+
+    if (!resumption_secret.isEmpty())
+    {
+        sendOne<PacketType::SessionTicket>(
+                    SessionTicket
+        {
+            server->issueTicket(resumption_secret),
+            server->getTicketLifetime()
+        });
+    }
+}
+
+void Session::doSynchronize(Synchronize d)
+{
+    if (id_room.isEmpty())
+    {
+        close("Client sent invalid data");
+        return;
+    }
+
+    auto messages = server->getHistory(id_room);
+
+    // Only messages newer than the one the client already has are sent
+    int floor = 0;
+
+    if (!d.id_message.isEmpty())
+    {
+        for (int i = messages.size() - 1; i >= 0; i--)
+        {
+            if (messages[i].id == d.id_message)
+            {
+                floor = i + 1;
+                break;
+            }
+        }
+    }
+
+    if (d.limit == 0)
+    {
+        if (batches)
+        {
+            for (int i = floor; i < messages.size(); i += HISTORY_BATCH_SIZE)
+            {
+                sendOne<PacketType::MessageBatch>(
+                            MessageBatch
+                {
+                    messages.mid(i, HISTORY_BATCH_SIZE),
+                    {}
+                });
+            }
+        }
+        else
+        {
+            for (int i = floor; i < messages.size(); i++)
+            {
+                sendOne<PacketType::Message>(messages[i]);
+            }
+        }
+
+        return;
+    }
+
+    // The cursor is the index of the oldest message handed out so far
+    int end = messages.size();
+
+    if (!d.cursor.isEmpty())
+    {
+        bool ok;
+        end = d.cursor.toInt(&ok);
+
+        if (!ok || end < floor || end > messages.size())
+        {
+            close("Client sent an invalid history cursor");
+            return;
+        }
+    }
+
+    int begin = qMax(floor, end - int(qMin(d.limit, MAX_HISTORY_PAGE_SIZE)));
+
+    sendOne<PacketType::MessageBatch>(
+                MessageBatch
+    {
+        messages.mid(begin, end - begin),
+        begin > floor
+        ? QByteArray::number(begin)
+        : QByteArray()
+    });
+}
+
+void Session::doMessage(Message d)
+{
+    if (id_room.isEmpty())
+    {
+        close("Client sent invalid data");
+        return;
+    }
+
+    server->post(id_room, this, d);
+}
+
+void Session::doRtRoom(RtRoom d)
+{
+    switch (d.request)
+    {
+    case RtRoom::Join:
+    {
+        if (!server->isRoomExists(d.id))
+        {
+            close("Client requested an unknown room");
+            return;
+        }
+
+        leave();
+
+        id_room = d.id;
+
+        sendOne<PacketType::ReRoom>(
+                    ReRoom
+        {
+            ReRoom::Joined
+        });
+
+        for (const auto &participant : server->getParticipants(id_room, this))
+        {
+            sendOne<PacketType::UserState>(
+                        UserState
+            {
+                participant,
+                UserState::Joined
+            });
+        }
+
+        server->announce(id_room, this, UserState::Joined);
+    }
+    break;
+
+    case RtRoom::Leave:
+    {
+        leave();
+
+        sendOne<PacketType::ReRoom>(
+                    ReRoom
+        {
+            ReRoom::Left
+        });
+    }
+    break;
+    }
+}
+
+void Session::doRtUpload(RtUpload d)
+{
+    auto error = ReUpload::NoError;
+
+    if (d.offset && !resumable)
+    {
+        close("Client resumed a transfer without resumable transfers");
+        return;
+    }
+
+    switch (d.request)
+    {
+    case RtUpload::Transmit:
+    {
+        if (d.id.size() != ID_SIZE
+                || d.size < 1
+                || d.size > MAX_FILE_SIZE
+                || d.offset < 0
+                || d.offset >= d.size
+                || transfers.contains(d.id)
+                || server->isFileExists(d.id))
+        {
+            error = ReUpload::BadRequest;
+            break;
+        }
+
+        // Only what the client knows to be confirmed is kept
+        auto data = server->takePartial(d.id);
+
+        if (data.size() < d.offset)
+        {
+            error = ReUpload::BadRequest;
+            break;
+        }
+
+        data.truncate(int(d.offset));
+
+        transfers.insert(d.id,
+        {
+            data,
+            d.size,
+            d.offset,
+            true
+        });
+    }
+    break;
+
+    case RtUpload::Receive:
+    {
+        if (!server->isFileExists(d.id))
+        {
+            error = ReUpload::NotFound;
+            break;
+        }
+
+        auto data = server->getFile(d.id);
+
+        if (d.size != data.size()
+                || d.offset < 0
+                || d.offset >= d.size
+                || transfers.contains(d.id))
+        {
+            error = ReUpload::BadRequest;
+            break;
+        }
+
+        transfers.insert(d.id,
+        {
+            data,
+            data.size(),
+            d.offset,
+            false
+        });
+
+        transfers[d.id].window.setChunkLimits(adaptiveChunks ? TransferWindow::MIN_CHUNK_SIZE : chunkSize,
+                                              chunkSize);
+    }
+    break;
+    }
+
+    sendOne<PacketType::ReUpload>(
+                ReUpload
+    {
+        d.id,
+        error != ReUpload::NoError
+        ? ReUpload::ErrorOccurred
+        : d.request == RtUpload::Transmit
+        ? ReUpload::ReadyRead
+        : ReUpload::ReadyWrite,
+        error
+    });
+}
+
+void Session::doUpload(Upload d)
+{
+    if (!transfers.contains(d.id))
+    {
+        // Chunks may still be in flight when the client cancels
+        return;
+    }
+
+    auto &transfer = transfers[d.id];
+
+    if (!transfer.incoming
+            || d.chunkdata.isEmpty()
+            || d.chunkdata.size() > transfer.size - transfer.offset)
+    {
+        close("Client sent invalid data");
+        return;
+    }
+
+    if (windowed && !transfer.window.receive(d.sequence))
+    {
+        close("Client sent a chunk out of order");
+        return;
+    }
+
+    transfer.data.append(d.chunkdata);
+    transfer.offset += d.chunkdata.size();
+
+    if (transfer.offset == transfer.size)
+    {
+        server->storeFile(d.id, transfer.data);
+
+        // With digests the client answers with its own before the transfer ends
+        if (!digests)
+        {
+            transfers.remove(d.id);
+        }
+
+        sendOne<PacketType::UploadState>(
+                    UploadState
+        {
+            d.id,
+            UploadState::Completed,
+            d.sequence,
+            digests ? server->getDigest(d.id) : QByteArray()
+        });
+    }
+    else
+    {
+        sendOne<PacketType::UploadState>(
+                    UploadState
+        {
+            d.id,
+            UploadState::Next,
+            d.sequence
+        });
+    }
+}
+
+void Session::doUploadState(UploadState d)
+{
+    if (!transfers.contains(d.id))
+    {
+        if (d.state != UploadState::Canceled)
+        {
+            close("Client sent invalid data");
+        }
+
+        return;
+    }
+
+    auto &transfer = transfers[d.id];
+
+    switch (d.state)
+    {
+    case UploadState::Next:
+    {
+        if (transfer.incoming
+                || (windowed
+                    ? transfer.window.acknowledge(d.sequence) < 0
+                    : transfer.offset >= transfer.size))
+        {
+            close("Client requested more data than available");
+            return;
+        }
+
+        // One chunk per acknowledgement, unless windowed
+        if (!windowed)
+        {
+            sendChunk(d.id, transfer);
+            break;
+        }
+
+        if (!scheduler.contains(d.id))
+        {
+            scheduler.add(d.id, &transfer.window);
+        }
+
+        schedule();
+    }
+    break;
+
+    case UploadState::Canceled:
+    {
+        scheduler.remove(d.id);
+        transfers.remove(d.id);
+
+        schedule();
+    }
+    break;
+
+    case UploadState::Completed:
+    {
+        if (transfer.offset < transfer.size)
+        {
+            close("Client completed an unfinished transfer");
+            return;
+        }
+
+        if (digests)
+        {
+            auto digest = server->getDigest(d.id);
+
+            if (d.digest != digest)
+            {
+                qWarning().noquote() << socket->peerAddress().toString()
+                                     << socket->peerPort()
+                                     << "File" << d.id.toHex() << "was corrupted in transfer";
+            }
+
+            // The client gets the digest of a download only now
+            if (!transfer.incoming)
+            {
+                sendOne<PacketType::UploadState>(
+                            UploadState
+                {
+                    d.id,
+                    UploadState::Completed,
+                    0,
+                    digest
+                });
+            }
+        }
+
+        scheduler.remove(d.id);
+        transfers.remove(d.id);
+
+        schedule();
+    }
+    break;
+    }
+}
+
+void Session::doPong(Ping d)
+{
+    Q_UNUSED(d)
+}
+
+void Session::leave()
+{
+    if (id_room.isEmpty())
+    {
+        return;
+    }
+
+    server->announce(id_room, this, UserState::Left);
+    id_room.clear();
+}
+
+void Session::schedule()
+{
+    auto size = [this](const QByteArray &id) -> qint64
+    {
+        const auto &transfer = *transfers.constFind(id);
+
+        return qMin(transfer.window.getChunkSize(), transfer.size - transfer.offset);
+    };
+
+    QByteArray id;
+
+    while (!(id = scheduler.next(size)).isEmpty())
+    {
+        sendChunk(id, transfers[id]);
+    }
+}
+
+void Session::sendChunk(const QByteArray &id, Transfer &transfer)
+{
+    auto chunk = transfer.data.mid(int(transfer.offset),
+                                   int(qMin(transfer.window.getChunkSize(), transfer.size - transfer.offset)));
+
+    transfer.offset += chunk.size();
+
+    sendOne<PacketType::Upload>(
+                Upload
+    {
+        id,
+        chunk,
+        windowed ? transfer.window.send(chunk.size()) : 0
+    });
+}
+
+template <PacketType P, typename T>
+bool Session::dispatch(void (Session::*handler)(T))
+{
+    static_assert(std::is_same<typename Outbound<P>::type, T>::value,
+                  "Handler does not match the packet type");
+
+    T d;
+
+    if (!transport->read(d))
+    {
+        return false;
+    }
+
+    (this->*handler)(d);
+    return true;
+}
+
+template <PacketType P>
+void Session::sendOne(const typename Inbound<P>::type &d)
+{
+    if (!socket->isOpen())
+    {
+        return;
+    }
+
+    // File chunks are rarely worth the CPU time
+    if (!transport->write(quint8(P), d, P != PacketType::Upload))
+    {
+        close(transport->getError());
+        return;
+    }
+
+    if (!flushTimer->isActive())
+    {
+        flushTimer->start();
+    }
+}
+
+void Session::flush()
+{
+    flushTimer->stop();
+
+    if (socket->isOpen())
+    {
+        transport->flush();
+    }
+}
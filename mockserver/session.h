@@ -0,0 +1,95 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include "core/transferscheduler.h"
+#include "core/transport.h"
+
+#include <QHash>
+#include <QTcpSocket>
+#include <QTimer>
+
+class MockServer;
+
+// Server side of one client connection
+class Session : public QObject
+{
+    Q_OBJECT
+public:
+    explicit Session(QTcpSocket *, MockServer *);
+
+    const QString &getUsername() const;
+    const QByteArray &getRoom() const;
+
+    void deliver(const Message &);
+    void announce(const UserState &);
+
+signals:
+    void closed();
+
+private slots:
+    void onDisconnected();
+    void onReadyRead();
+
+private:
+    struct Transfer
+    {
+        QByteArray data;
+        qint64 size;
+        qint64 offset;
+        bool incoming;
+        TransferWindow window;
+    };
+
+    QTcpSocket *socket;
+    MockServer *server;
+    Transport *transport;
+
+    bool authorized;
+    bool batches;
+    bool windowed;
+    bool adaptiveChunks;
+    bool resumable;
+    bool digests;
+    bool resumptionAttempted;
+    bool retried;
+    qint64 chunkSize;
+
+    QString username;
+    QByteArray id_room;
+
+    Suite suite;
+    QVector<quint8> public_key;
+    QVector<quint8> secret_key;
+    QVector<quint8> resumption_secret;
+
+    QHash<QByteArray, Transfer> transfers;
+    TransferScheduler scheduler;
+
+    QTimer *flushTimer;
+    QTimer *pingTimer;
+
+    void doHandshake(ClientKeyExchange);
+    void doRtAuthorization(RtAuthorization);
+    void doSynchronize(Synchronize);
+    void doMessage(Message);
+    void doRtRoom(RtRoom);
+    void doRtUpload(RtUpload);
+    void doUpload(Upload);
+    void doUploadState(UploadState);
+    void doPong(Ping);
+
+    void offer(Suite::Kem);
+    void close(const QString & = {});
+    void leave();
+    void schedule();
+    void sendChunk(const QByteArray &, Transfer &);
+
+    bool handle(quint8);
+    template <PacketType P, typename T>
+    bool dispatch(void (Session::*)(T));
+    template <PacketType P>
+    void sendOne(const typename Inbound<P>::type &);
+    void flush();
+};
+
+#endif // SESSION_H
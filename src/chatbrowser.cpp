@@ -1,6 +1,7 @@
 #include "chatbrowser.h"
 #include "core/client.h"
 
+#include <QScrollBar>
 #include <QUrlQuery>
 
 ChatBrowser::ChatBrowser(QWidget *parent) : QTextBrowser(parent)
@@ -8,6 +9,27 @@ ChatBrowser::ChatBrowser(QWidget *parent) : QTextBrowser(parent)
 }
 
 void ChatBrowser::append(QString message, const QString &sender, const QDateTime &dt)
+{
+    QTextBrowser::append(format(message, sender, dt));
+    QTextBrowser::moveCursor(QTextCursor::End);
+}
+
+void ChatBrowser::prepend(QString message, const QString &sender, const QDateTime &dt)
+{
+    // Keep the visible part of the document in place
+    auto scrollBar = verticalScrollBar();
+    auto distance = scrollBar->maximum() - scrollBar->value();
+
+    QTextCursor cursor(document());
+    cursor.movePosition(QTextCursor::Start);
+    cursor.insertBlock();
+    cursor.movePosition(QTextCursor::Start);
+    cursor.insertHtml(format(message, sender, dt));
+
+    scrollBar->setValue(scrollBar->maximum() - distance);
+}
+
+QString ChatBrowser::format(QString message, const QString &sender, const QDateTime &dt) const
 {
     message = message.trimmed();
 
@@ -58,6 +80,5 @@ void ChatBrowser::append(QString message, const QString &sender, const QDateTime
                .arg(message);
     }
 
-    QTextBrowser::append(html);
-    QTextBrowser::moveCursor(QTextCursor::End);
+    return html;
 }
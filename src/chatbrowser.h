@@ -14,9 +14,13 @@ public:
 public slots:
     void append(QString, const QString & = {},
                 const QDateTime & = QDateTime::currentDateTime());
+    void prepend(QString, const QString & = {},
+                 const QDateTime & = QDateTime::currentDateTime());
 
 private:
     const QRegularExpression re { "((?:https?|ftp|neutron)://\\S+)" };
+
+    QString format(QString, const QString &, const QDateTime &) const;
 };
 
 #endif // CHATBROWSER_H
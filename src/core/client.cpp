@@ -1,4 +1,5 @@
 #include "client.h"
+#include "pqcrypto.h"
 
 #include <QApplication>
 #include <QDir>
@@ -8,14 +9,14 @@
 #include <QSqlQuery>
 #include <QStandardPaths>
 
-#include <oqs/oqs.h>
-
 QSettings Client::settings
 {
     "client.ini",
     QSettings::IniFormat
 };
 QThread *Client::workerThread = new QThread;
+QThread *Client::pipelineThread = new QThread;
+QThreadPool *Client::cryptoPool = new QThreadPool;
 
 Client::Client()
 {
@@ -33,11 +34,18 @@ Client::Client()
     initDatabase();
 
     workerThread->start();
+    pipelineThread->start();
+
+    // Handshakes run two operations in parallel, even on a single core
+    cryptoPool->setMaxThreadCount(qMax(QThread::idealThreadCount(), 2));
 
     connect(qApp, &QApplication::aboutToQuit, [ = ]
     {
+        cryptoPool->waitForDone();
         workerThread->quit();
         workerThread->wait();
+        pipelineThread->quit();
+        pipelineThread->wait();
     });
 }
 
@@ -51,6 +59,16 @@ QThread *Client::getWorkerThread()
     return workerThread;
 }
 
+QThread *Client::getPipelineThread()
+{
+    return pipelineThread;
+}
+
+QThreadPool *Client::getCryptoPool()
+{
+    return cryptoPool;
+}
+
 void Client::error(const QString &reason)
 {
     QMessageBox::critical(nullptr,
@@ -62,9 +80,10 @@ void Client::error(const QString &reason)
 
 void Client::initCrypto()
 {
-    #if !defined (OQS_ENABLE_KEM_sidh_p751) || !defined (OQS_ENABLE_SIG_picnic2_L5_FS)
-    error("The required post quantum algorithms are not available for use");
-    #endif
+    if (KeyEncapsulation::available().isEmpty() || DigitalSignature::available().isEmpty())
+    {
+        error("The required post quantum algorithms are not available for use");
+    }
 }
 
 void Client::initDatabase()
@@ -94,6 +113,14 @@ void Client::initDatabase()
                     "ID_SENDER  TEXT    NOT NULL,"
                     "CONTENT    TEXT    NOT NULL"
                     ")")
+            || !query.exec("CREATE TABLE IF NOT EXISTS GAPS"
+                           "("
+                           "ID_SERVER BLOB NOT NULL,"
+                           "ID_ROOM   BLOB NOT NULL,"
+                           "FLOOR     BLOB NOT NULL,"
+                           "CURSOR    BLOB NOT NULL,"
+                           "PRIMARY KEY (ID_SERVER, ID_ROOM, FLOOR)"
+                           ")")
             || !query.exec("CREATE TABLE IF NOT EXISTS ROOMS"
                            "("
                            "ID        BLOB NOT NULL,"
@@ -106,6 +133,38 @@ void Client::initDatabase()
                            "ID   BLOB NOT NULL,"
                            "NAME TEXT NOT NULL,"
                            "PRIMARY KEY (ID)"
+                           ")")
+            // Tickets are kept in memory now, with no secret left on disk
+            || !query.exec("DROP TABLE IF EXISTS TICKETS")
+            || !query.exec("CREATE TABLE IF NOT EXISTS TRANSFERS"
+                           "("
+                           "ID_FILE   BLOB    NOT NULL,"
+                           "ID_SERVER BLOB    NOT NULL,"
+                           "PATH      TEXT    NOT NULL,"
+                           "SIZE      BIGINT  NOT NULL,"
+                           "REQUEST   INTEGER NOT NULL,"
+                           "CONFIRMED BIGINT  NOT NULL,"
+                           "HASH      BLOB    NOT NULL,"
+                           "EXPIRY    BIGINT  NOT NULL,"
+                           "PRIMARY KEY (ID_FILE, ID_SERVER)"
+                           ")")
+            || !query.exec("CREATE TABLE IF NOT EXISTS FILES"
+                           "("
+                           "ID_FILE   BLOB   NOT NULL,"
+                           "ID_SERVER BLOB   NOT NULL,"
+                           "PATH      TEXT   NOT NULL,"
+                           "SIZE      BIGINT NOT NULL,"
+                           "DIGEST    BLOB   NOT NULL,"
+                           "PRIMARY KEY (ID_FILE, ID_SERVER)"
+                           ")")
+            || !query.exec("CREATE INDEX IF NOT EXISTS FILES_DIGEST"
+                           " ON FILES (DIGEST)")
+            || !query.exec("CREATE TABLE IF NOT EXISTS CACHE"
+                           "("
+                           "DIGEST    BLOB   NOT NULL,"
+                           "SIZE      BIGINT NOT NULL,"
+                           "LAST_USED BIGINT NOT NULL,"
+                           "PRIMARY KEY (DIGEST)"
                            ")"))
     {
         error(query.lastError().text());
@@ -3,6 +3,7 @@
 
 #include <QSettings>
 #include <QThread>
+#include <QThreadPool>
 
 class Client : public QObject
 {
@@ -12,12 +13,16 @@ public:
 
     static QSettings &getSettings();
     static QThread *getWorkerThread();
+    static QThread *getPipelineThread();
+    static QThreadPool *getCryptoPool();
 
     [[ noreturn ]] static void error(const QString &);
 
 private:
     static QSettings settings;
     static QThread *workerThread;
+    static QThread *pipelineThread;
+    static QThreadPool *cryptoPool;
 
     static void initCrypto();
     static void initDatabase();
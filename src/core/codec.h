@@ -0,0 +1,157 @@
+#ifndef CODEC_H
+#define CODEC_H
+
+#include "packet.h"
+
+#include <QDataStream>
+
+#include <cstring>
+
+// Compile-time description of every packet structure.
+//
+// With the legacy encoding frames are still wrapped into the envelope
+// QVariant::save used to produce (user type id, null flag, type name), so the
+// server sees the same bytes, but nothing goes through QVariant or the
+// metatype registry anymore. The compact encoding has no envelope at all,
+// the frame type alone identifies the structure.
+template <typename T>
+struct PacketTraits;
+
+// Structure carried by each packet type, per direction
+template <PacketType>
+struct Inbound;
+template <PacketType>
+struct Outbound;
+
+#define DECLARE_PACKET(T) \
+    template <> \
+    struct PacketTraits<T> \
+    { \
+        static constexpr const char *name() { return #T; } \
+    };
+
+#define DECLARE_INBOUND(P, T) \
+    template <> \
+    struct Inbound<PacketType::P> \
+    { \
+        using type = T; \
+    };
+
+#define DECLARE_OUTBOUND(P, T) \
+    template <> \
+    struct Outbound<PacketType::P> \
+    { \
+        using type = T; \
+    };
+
+DECLARE_PACKET(ServerKeyExchange)
+DECLARE_PACKET(ClientKeyExchange)
+DECLARE_PACKET(ReResumption)
+DECLARE_PACKET(SessionTicket)
+DECLARE_PACKET(RtAuthorization)
+DECLARE_PACKET(ReAuthorization)
+DECLARE_PACKET(Established)
+DECLARE_PACKET(Synchronize)
+DECLARE_PACKET(UserState)
+DECLARE_PACKET(Message)
+DECLARE_PACKET(MessageBatch)
+DECLARE_PACKET(RtRoom)
+DECLARE_PACKET(ReRoom)
+DECLARE_PACKET(RtUpload)
+DECLARE_PACKET(ReUpload)
+DECLARE_PACKET(Upload)
+DECLARE_PACKET(UploadState)
+DECLARE_PACKET(Ping)
+
+DECLARE_INBOUND(Handshake, ServerKeyExchange)
+DECLARE_INBOUND(Resumption, ReResumption)
+DECLARE_INBOUND(SessionTicket, SessionTicket)
+DECLARE_INBOUND(ReAuthorization, ReAuthorization)
+DECLARE_INBOUND(Established, Established)
+DECLARE_INBOUND(UserState, UserState)
+DECLARE_INBOUND(Message, Message)
+DECLARE_INBOUND(MessageBatch, MessageBatch)
+DECLARE_INBOUND(ReRoom, ReRoom)
+DECLARE_INBOUND(ReUpload, ReUpload)
+DECLARE_INBOUND(Upload, Upload)
+DECLARE_INBOUND(UploadState, UploadState)
+DECLARE_INBOUND(Ping, Ping)
+
+DECLARE_OUTBOUND(Handshake, ClientKeyExchange)
+DECLARE_OUTBOUND(RtAuthorization, RtAuthorization)
+DECLARE_OUTBOUND(Synchronize, Synchronize)
+DECLARE_OUTBOUND(Message, Message)
+DECLARE_OUTBOUND(RtRoom, RtRoom)
+DECLARE_OUTBOUND(RtUpload, RtUpload)
+DECLARE_OUTBOUND(Upload, Upload)
+DECLARE_OUTBOUND(UploadState, UploadState)
+DECLARE_OUTBOUND(Pong, Ping)
+
+#undef DECLARE_PACKET
+#undef DECLARE_INBOUND
+#undef DECLARE_OUTBOUND
+
+namespace Codec
+{
+// QVariant::UserType, written in front of every user type name
+static constexpr quint32 USER_TYPE = 1024;
+
+template <typename T>
+bool encode(QDataStream &out, const T &d)
+{
+    out << USER_TYPE
+        << qint8(false)
+        << PacketTraits<T>::name()
+        << d;
+
+    return out.status() == QDataStream::Ok;
+}
+
+template <typename T>
+bool decode(QDataStream &in, T &d)
+{
+    quint32 type;
+    qint8 null;
+    quint32 length;
+    in >> type >> null >> length;
+
+    // The name is stored with its terminating null character
+    const char *name = PacketTraits<T>::name();
+    const auto size = std::strlen(name) + 1;
+
+    char buffer[32];
+
+    if (in.status() != QDataStream::Ok
+            || type != USER_TYPE
+            || null
+            || length != size
+            || size > sizeof(buffer)
+            || in.readRawData(buffer, int(size)) != int(size)
+            || std::memcmp(buffer, name, size) != 0)
+    {
+        return false;
+    }
+
+    in >> d;
+
+    return in.status() == QDataStream::Ok;
+}
+
+template <typename T>
+bool encode(CompactStream &out, const T &d)
+{
+    out << d;
+
+    return out.status() == CompactStream::Ok;
+}
+
+template <typename T>
+bool decode(CompactStream &in, T &d)
+{
+    in >> d;
+
+    return in.status() == CompactStream::Ok;
+}
+}
+
+#endif // CODEC_H
@@ -0,0 +1,269 @@
+#include "compactstream.h"
+
+static constexpr int ID_SIZE = 16;
+
+CompactStream::CompactStream()
+    : dev(nullptr)
+    , q_status(Ok)
+{
+}
+
+CompactStream::CompactStream(QIODevice *device)
+    : dev(device)
+    , q_status(Ok)
+{
+}
+
+QIODevice *CompactStream::device() const
+{
+    return dev;
+}
+
+void CompactStream::setDevice(QIODevice *device)
+{
+    dev = device;
+}
+
+bool CompactStream::atEnd() const
+{
+    return dev ? dev->atEnd() : true;
+}
+
+CompactStream::Status CompactStream::status() const
+{
+    return q_status;
+}
+
+void CompactStream::resetStatus()
+{
+    q_status = Ok;
+}
+
+void CompactStream::setStatus(Status status)
+{
+    if (q_status == Ok)
+    {
+        q_status = status;
+    }
+}
+
+void CompactStream::writeVarint(quint64 value)
+{
+    char data[10];
+    int size = 0;
+
+    do
+    {
+        data[size] = char(value & 0x7f);
+        value >>= 7;
+
+        if (value)
+        {
+            data[size] |= char(0x80);
+        }
+
+        size++;
+    }
+    while (value);
+
+    dev->write(data, size);
+}
+
+quint64 CompactStream::readVarint()
+{
+    quint64 value = 0;
+
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+        char c;
+
+        if (!dev->getChar(&c))
+        {
+            setStatus(ReadPastEnd);
+            return 0;
+        }
+
+        value |= quint64(quint8(c) & 0x7f) << shift;
+
+        if (!(quint8(c) & 0x80))
+        {
+            return value;
+        }
+    }
+
+    setStatus(ReadCorruptData);
+    return 0;
+}
+
+bool CompactStream::readRaw(char *data, qint64 size)
+{
+    if (dev->read(data, size) != size)
+    {
+        setStatus(ReadPastEnd);
+        return false;
+    }
+
+    return true;
+}
+
+CompactStream &CompactStream::operator<<(bool value)
+{
+    dev->putChar(value ? 1 : 0);
+    return *this;
+}
+
+CompactStream &CompactStream::operator<<(quint32 value)
+{
+    writeVarint(value);
+    return *this;
+}
+
+CompactStream &CompactStream::operator<<(qint64 value)
+{
+    // Zigzag, so that small negative numbers stay short
+    writeVarint((quint64(value) << 1) ^ quint64(value >> 63));
+    return *this;
+}
+
+CompactStream &CompactStream::operator<<(const QByteArray &value)
+{
+    writeVarint(quint64(value.size()));
+    dev->write(value);
+    return *this;
+}
+
+CompactStream &CompactStream::operator<<(const QString &value)
+{
+    return *this << value.toUtf8();
+}
+
+CompactStream &CompactStream::operator<<(const QVector<quint8> &value)
+{
+    writeVarint(quint64(value.size()));
+    dev->write(reinterpret_cast<const char *>(value.constData()), value.size());
+    return *this;
+}
+
+CompactStream &CompactStream::operator<<(FixedId<const QByteArray> value)
+{
+    static const char empty[ID_SIZE] {};
+
+    if (value.id.isEmpty())
+    {
+        dev->write(empty, ID_SIZE);
+    }
+    else if (value.id.size() != ID_SIZE)
+    {
+        // Legacy ids from the archive may have any length
+        setStatus(WriteFailed);
+    }
+    else
+    {
+        dev->write(value.id.constData(), ID_SIZE);
+    }
+
+    return *this;
+}
+
+CompactStream &CompactStream::operator>>(bool &value)
+{
+    char c;
+
+    if (!dev->getChar(&c))
+    {
+        setStatus(ReadPastEnd);
+        return *this;
+    }
+
+    value = c != 0;
+    return *this;
+}
+
+CompactStream &CompactStream::operator>>(quint32 &value)
+{
+    auto v = readVarint();
+
+    if (v > 0xffffffff)
+    {
+        setStatus(ReadCorruptData);
+    }
+
+    value = quint32(v);
+    return *this;
+}
+
+CompactStream &CompactStream::operator>>(qint64 &value)
+{
+    auto v = readVarint();
+    value = qint64(v >> 1) ^ -qint64(v & 1);
+    return *this;
+}
+
+CompactStream &CompactStream::operator>>(QByteArray &value)
+{
+    value.clear();
+
+    auto size = readVarint();
+
+    if (q_status != Ok)
+    {
+        return *this;
+    }
+
+    if (size > quint64(dev->bytesAvailable()))
+    {
+        setStatus(ReadPastEnd);
+        return *this;
+    }
+
+    value.resize(int(size));
+    readRaw(value.data(), value.size());
+    return *this;
+}
+
+CompactStream &CompactStream::operator>>(QString &value)
+{
+    QByteArray utf8;
+    *this >> utf8;
+    value = QString::fromUtf8(utf8);
+    return *this;
+}
+
+CompactStream &CompactStream::operator>>(QVector<quint8> &value)
+{
+    value.clear();
+
+    auto size = readVarint();
+
+    if (q_status != Ok)
+    {
+        return *this;
+    }
+
+    if (size > quint64(dev->bytesAvailable()))
+    {
+        setStatus(ReadPastEnd);
+        return *this;
+    }
+
+    value.resize(int(size));
+    readRaw(reinterpret_cast<char *>(value.data()), value.size());
+    return *this;
+}
+
+CompactStream &CompactStream::operator>>(FixedId<QByteArray> value)
+{
+    value.id.resize(ID_SIZE);
+
+    if (!readRaw(value.id.data(), ID_SIZE))
+    {
+        return *this;
+    }
+
+    if (value.id.count('\0') == ID_SIZE)
+    {
+        value.id.clear();
+    }
+
+    return *this;
+}
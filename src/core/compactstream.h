@@ -0,0 +1,155 @@
+#ifndef COMPACTSTREAM_H
+#define COMPACTSTREAM_H
+
+#include <QIODevice>
+#include <QVector>
+
+#include <type_traits>
+
+// Encoding version 2.
+//
+// Integers and enums are LEB128 varints (signed ones zigzag encoded),
+// strings are UTF-8 and byte arrays carry a varint length. Ids wrapped with
+// fixedId() travel as exactly 16 raw bytes, an empty id as 16 zero bytes.
+// Ids of any other length can't be encoded and fail the write.
+//
+// Every enum read from the stream needs an EnumRange, values past its last
+// enumerator are corrupt data.
+template <typename T>
+struct EnumRange;
+
+#define DECLARE_ENUM_RANGE(T, LAST) \
+    template <> \
+    struct EnumRange<T> \
+    { \
+        static constexpr quint64 last = quint64(LAST); \
+    };
+
+class CompactStream
+{
+public:
+    enum Status
+    {
+        Ok,
+        ReadPastEnd,
+        ReadCorruptData,
+        WriteFailed
+    };
+
+    explicit CompactStream();
+    explicit CompactStream(QIODevice *);
+
+    QIODevice *device() const;
+    void setDevice(QIODevice *);
+
+    bool atEnd() const;
+
+    Status status() const;
+    void resetStatus();
+    void setStatus(Status);
+
+    void writeVarint(quint64);
+    quint64 readVarint();
+
+    CompactStream &operator<<(bool);
+    CompactStream &operator<<(quint32);
+    CompactStream &operator<<(qint64);
+    CompactStream &operator<<(const QByteArray &);
+    CompactStream &operator<<(const QString &);
+    CompactStream &operator<<(const QVector<quint8> &);
+
+    CompactStream &operator>>(bool &);
+    CompactStream &operator>>(quint32 &);
+    CompactStream &operator>>(qint64 &);
+    CompactStream &operator>>(QByteArray &);
+    CompactStream &operator>>(QString &);
+    CompactStream &operator>>(QVector<quint8> &);
+
+    template <typename T, typename = typename std::enable_if<std::is_enum<T>::value>::type>
+    CompactStream &operator<<(T value)
+    {
+        writeVarint(quint64(value));
+        return *this;
+    }
+
+    template <typename T, typename = typename std::enable_if<std::is_enum<T>::value>::type>
+    CompactStream &operator>>(T &value)
+    {
+        auto v = readVarint();
+
+        if (v > EnumRange<T>::last)
+        {
+            setStatus(ReadCorruptData);
+            v = 0;
+        }
+
+        value = T(v);
+        return *this;
+    }
+
+    template <typename T>
+    CompactStream &operator<<(const QVector<T> &values)
+    {
+        writeVarint(quint64(values.size()));
+
+        for (const auto &value : values)
+        {
+            *this << value;
+        }
+
+        return *this;
+    }
+
+    template <typename T>
+    CompactStream &operator>>(QVector<T> &values)
+    {
+        values.clear();
+
+        auto count = readVarint();
+
+        // Every element takes at least one byte
+        if (count > quint64(dev->bytesAvailable()))
+        {
+            setStatus(ReadCorruptData);
+            return *this;
+        }
+
+        values.reserve(int(count));
+
+        for (quint64 i = 0; i < count && q_status == Ok; i++)
+        {
+            T value;
+            *this >> value;
+            values.append(value);
+        }
+
+        return *this;
+    }
+
+    template <typename T>
+    struct FixedId
+    {
+        T &id;
+    };
+
+    CompactStream &operator<<(FixedId<const QByteArray>);
+    CompactStream &operator>>(FixedId<QByteArray>);
+
+private:
+    QIODevice *dev;
+    Status q_status;
+
+    bool readRaw(char *, qint64);
+};
+
+inline CompactStream::FixedId<const QByteArray> fixedId(const QByteArray &id)
+{
+    return { id };
+}
+
+inline CompactStream::FixedId<QByteArray> fixedId(QByteArray &id)
+{
+    return { id };
+}
+
+#endif // COMPACTSTREAM_H
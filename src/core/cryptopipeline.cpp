@@ -0,0 +1,34 @@
+#include "cryptopipeline.h"
+
+CryptoPipeline::CryptoPipeline(const QVector<quint8> &secret,
+                               SessionCipher::Role role,
+                               SessionCipher::Algorithm algorithm)
+{
+    cipher.setSecret(secret, role, algorithm);
+}
+
+void CryptoPipeline::encrypt(quint64 counter, QByteArray frame, int headerSize)
+{
+    auto data = reinterpret_cast<quint8 *>(frame.data());
+    auto offset = headerSize + SessionCipher::TAG_SIZE;
+
+    cipher.encrypt(counter,
+                   data + headerSize,
+                   data + offset, size_t(frame.size() - offset),
+                   data, size_t(headerSize));
+
+    emit encrypted(frame);
+}
+
+void CryptoPipeline::decrypt(quint64 counter, QByteArray frame, int headerSize)
+{
+    auto data = reinterpret_cast<quint8 *>(frame.data());
+    auto offset = headerSize + SessionCipher::TAG_SIZE;
+
+    auto ok = cipher.decrypt(counter,
+                             data + headerSize,
+                             data + offset, size_t(frame.size() - offset),
+                             data, size_t(headerSize));
+
+    emit decrypted(frame, ok);
+}
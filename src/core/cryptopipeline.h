@@ -0,0 +1,32 @@
+#ifndef CRYPTOPIPELINE_H
+#define CRYPTOPIPELINE_H
+
+#include "sessioncipher.h"
+
+#include <QObject>
+
+// Session key encryption of large frames, on a thread of its own.
+//
+// Lives on the thread passed to Transport::setPipelineThread and works on
+// whole frames (header, tag, payload) handed over through queued calls.
+// Frames come back in the order they were submitted, each one processed
+// with the nonce it was given on submission.
+class CryptoPipeline : public QObject
+{
+    Q_OBJECT
+public:
+    explicit CryptoPipeline(const QVector<quint8> &, SessionCipher::Role, SessionCipher::Algorithm);
+
+signals:
+    void encrypted(QByteArray);
+    void decrypted(QByteArray, bool);
+
+public slots:
+    void encrypt(quint64, QByteArray, int);
+    void decrypt(quint64, QByteArray, int);
+
+private:
+    SessionCipher cipher;
+};
+
+#endif // CRYPTOPIPELINE_H
@@ -5,7 +5,9 @@
 #include <QDir>
 #include <QFileInfo>
 
-static constexpr qint64 PAGE_SIZE = 32768;
+#include <cstring>
+
+constexpr qint64 File::PAGE_SIZE;
 
 File::File()
 {
@@ -21,11 +23,17 @@ File::File(const QString &name) : QFile(name)
 
 File::~File()
 {
+    if (mapping)
+    {
+        unmap(mapping);
+    }
+
     if (isOpen())
     {
         if (isWritable())
         {
-            if (!atEnd() || autoRemove)
+            // Partial downloads are kept unless canceled, to be resumed
+            if (autoRemove || (!atEnd() && (!resumable || cancellationRequested)))
             {
                 remove();
             }
@@ -50,6 +58,11 @@ QString File::getName() const
     return QFileInfo(*this).fileName();
 }
 
+QString File::getPath() const
+{
+    return QFileInfo(*this).absoluteFilePath();
+}
+
 qint64 File::getLastRead() const
 {
     return lastRead;
@@ -65,26 +78,173 @@ qint64 File::getRemained() const
     return size() - pos();
 }
 
+qint64 File::getConfirmed() const
+{
+    return confirmed;
+}
+
+QByteArray File::getHash() const
+{
+    auto copy = hash;
+
+    QByteArray digest(int(copy.DigestSize()), Qt::Uninitialized);
+    copy.Final(reinterpret_cast<quint8 *>(digest.data()));
+
+    return digest;
+}
+
+QByteArray File::getDigest() const
+{
+    auto copy = digest;
+
+    QByteArray result(int(copy.DigestSize()), Qt::Uninitialized);
+    copy.Final(reinterpret_cast<quint8 *>(result.data()));
+
+    return result;
+}
+
+TransferScheduler::Priority File::getPriority() const
+{
+    return priority;
+}
+
+TransferWindow &File::getWindow()
+{
+    return window;
+}
+
+RateLimiter &File::getLimiter()
+{
+    return limiter;
+}
+
 void File::setId(const QByteArray &id)
 {
     this->id = id;
 }
 
+void File::setPriority(TransferScheduler::Priority priority)
+{
+    this->priority = priority;
+}
+
+void File::setResumable(bool resumable)
+{
+    this->resumable = resumable;
+}
+
+void File::setDigested(bool digested)
+{
+    this->digested = digested;
+}
+
 void File::requestCancellation()
 {
     cancellationRequested = true;
 }
 
-QByteArray File::read()
+void File::discard()
+{
+    autoRemove = true;
+}
+
+void File::confirm(qint64 length)
 {
+    if (resumable)
+    {
+        auto base = getMapping();
+
+        if (base && confirmed + length <= mappingSize)
+        {
+            hash.Update(base + confirmed, size_t(length));
+        }
+        else
+        {
+            auto position = pos();
+            seek(confirmed);
+
+            for (auto remained = length; remained > 0; )
+            {
+                auto data = QIODevice::read(qMin(remained, PAGE_SIZE));
+
+                if (data.isEmpty())
+                {
+                    Client::error(tr("Error reading from file"));
+                }
+
+                hash.Update(reinterpret_cast<const quint8 *>(data.constData()), size_t(data.size()));
+                remained -= data.size();
+            }
+
+            seek(position);
+        }
+    }
+
+    confirmed += length;
+}
+
+bool File::resume(qint64 offset, const QByteArray &expected)
+{
+    rewind();
+
+    if (offset < 1 || offset >= size())
+    {
+        return false;
+    }
+
+    confirm(offset);
+
+    if (getHash() != expected)
+    {
+        rewind();
+        return false;
+    }
+
+    // The part already transferred is in the digest without reading it again
+    digest = hash;
+
+    seek(offset);
+    return true;
+}
+
+void File::rewind()
+{
+    hash.Restart();
+    digest.Restart();
+    confirmed = 0;
+    seek(0);
+}
+
+QByteArray File::read(qint64 size)
+{
+    size = qMin(getRemained(), size);
+
     QByteArray data;
-    data.resize(qMin(getRemained(), PAGE_SIZE));
 
-    lastRead = QIODevice::read(data.data(), data.size());
+    auto base = getMapping();
+
+    if (base && pos() + size <= mappingSize)
+    {
+        data = QByteArray(reinterpret_cast<const char *>(base + pos()), int(size));
 
-    if (qint64(data.size()) != lastRead)
+        lastRead = size;
+        seek(pos() + size);
+    }
+    else
     {
-        Client::error(tr("Error reading from file"));
+        data.resize(int(size));
+
+        lastRead = QIODevice::read(data.data(), data.size());
+
+        if (qint64(data.size()) != lastRead)
+        {
+            Client::error(tr("Error reading from file"));
+        }
+    }
+
+    if (digested)
+    {
+        digest.Update(reinterpret_cast<const quint8 *>(data.constData()), size_t(data.size()));
     }
 
     return data;
@@ -92,6 +252,23 @@ QByteArray File::read()
 
 void File::write(const QByteArray &data)
 {
+    if (digested)
+    {
+        digest.Update(reinterpret_cast<const quint8 *>(data.constData()), size_t(data.size()));
+    }
+
+    auto base = getMapping();
+
+    if (base && pos() + data.size() <= mappingSize)
+    {
+        std::memcpy(base + pos(), data.constData(), size_t(data.size()));
+
+        lastWritten = data.size();
+        seek(pos() + lastWritten);
+
+        return;
+    }
+
     lastWritten = QIODevice::write(data.constData(), data.size());
 
     if (qint64(data.size()) != lastWritten)
@@ -99,3 +276,35 @@ void File::write(const QByteArray &data)
         Client::error(tr("Error writing to file"));
     }
 }
+
+uchar *File::getMapping()
+{
+    // Mapped on first use, only downloads the client sized itself
+    if (!mappingAttempted)
+    {
+        mappingAttempted = true;
+
+        if (!isWritable())
+        {
+            return nullptr;
+        }
+
+        flush();
+
+        mappingSize = size();
+
+        if (mappingSize > 0)
+        {
+            mapping = map(0, mappingSize);
+        }
+    }
+
+    // Another process may still have resized it, the buffered path reports
+    // an error instead of raising SIGBUS
+    if (mapping && size() != mappingSize)
+    {
+        return nullptr;
+    }
+
+    return mapping;
+}
@@ -1,8 +1,22 @@
 #ifndef FILE_H
 #define FILE_H
 
+#include "ratelimiter.h"
+#include "transferscheduler.h"
+
 #include <QFile>
 
+#include <cryptopp/blake2.h>
+
+// Downloads, sized beforehand, are written straight into a mapping of the
+// whole file where the platform allows it. Files picked for upload are read
+// through the buffer, as any other process may truncate them while they are
+// sent and touching mapped pages past the end of a file raises SIGBUS.
+//
+// Resumable transfers hash the bytes the peer confirmed as they go, so that
+// a transfer picked up later can check the file still starts with them.
+// With digests every chunk read or written is hashed as well, which gives
+// the digest of the whole file once the transfer is through.
 class File : public QFile
 {
     Q_OBJECT
@@ -11,19 +25,37 @@ public:
     explicit File(const QString &);
     ~File();
 
+    static constexpr qint64 PAGE_SIZE = 32768;
+
     bool isCancellationRequested() const;
 
     const QByteArray &getId() const;
     QString getName() const;
+    QString getPath() const;
     qint64 getLastRead() const;
     qint64 getLastWritten() const;
     qint64 getRemained() const;
+    qint64 getConfirmed() const;
+    QByteArray getHash() const;
+    QByteArray getDigest() const;
+    TransferScheduler::Priority getPriority() const;
+    TransferWindow &getWindow();
+    RateLimiter &getLimiter();
 
     void setId(const QByteArray &);
+    void setPriority(TransferScheduler::Priority);
+    void setResumable(bool);
+    void setDigested(bool);
 
     void requestCancellation();
+    // Removes the file once closed, even when complete
+    void discard();
 
-    QByteArray read();
+    void confirm(qint64);
+    bool resume(qint64, const QByteArray &);
+    void rewind();
+
+    QByteArray read(qint64 = PAGE_SIZE);
     void write(const QByteArray &);
 
 private:
@@ -32,6 +64,19 @@ private:
     qint64 lastWritten = 0;
     bool autoRemove = false;
     bool cancellationRequested = false;
+    bool resumable = false;
+    bool digested = false;
+    qint64 confirmed = 0;
+    CryptoPP::BLAKE2b hash;
+    CryptoPP::BLAKE2b digest;
+    TransferWindow window;
+    RateLimiter limiter;
+    TransferScheduler::Priority priority = TransferScheduler::Normal;
+    uchar *mapping = nullptr;
+    qint64 mappingSize = 0;
+    bool mappingAttempted = false;
+
+    uchar *getMapping();
 };
 
 #endif // FILE_H
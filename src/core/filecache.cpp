@@ -0,0 +1,195 @@
+#include "filecache.h"
+#include "client.h"
+
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QVector>
+
+constexpr qint64 FileCache::DEFAULT_MAX_SIZE;
+
+// Directory of the cached copies, next to the database
+static const char *CACHE_DIRECTORY = "cache";
+
+FileCache::FileCache(const QSqlDatabase &db)
+    : db(db)
+{
+}
+
+qint64 FileCache::getMaxSize()
+{
+    return Client::getSettings().value("Cache/MaxSize", DEFAULT_MAX_SIZE).toLongLong();
+}
+
+QString FileCache::getPath(const QByteArray &digest)
+{
+    return QDir(CACHE_DIRECTORY).absoluteFilePath(digest.toHex());
+}
+
+bool FileCache::store(const QString &source, const QByteArray &digest)
+{
+    auto path = getPath(digest);
+    auto part = path + ".part";
+
+    if (!QDir().mkpath(CACHE_DIRECTORY))
+    {
+        return false;
+    }
+
+    // Copied under another name first, so a copy cut short is never found
+    QFile::remove(part);
+    QFile::remove(path);
+
+    if (!QFile::copy(source, part) || !QFile::rename(part, path))
+    {
+        QFile::remove(part);
+        return false;
+    }
+
+    return true;
+}
+
+bool FileCache::contains(const QByteArray &digest)
+{
+    QSqlQuery query(db);
+    query.prepare("SELECT SIZE"
+                  " FROM CACHE"
+                  " WHERE DIGEST = ?");
+    query.addBindValue(digest);
+
+    if (!query.exec())
+    {
+        Client::error(query.lastError().text());
+    }
+
+    if (!query.next())
+    {
+        return false;
+    }
+
+    // Copies removed behind our back are forgotten
+    if (QFileInfo(getPath(digest)).size() != query.value(0).toLongLong())
+    {
+        remove(digest);
+        return false;
+    }
+
+    return true;
+}
+
+QString FileCache::find(const QByteArray &id, const QByteArray &server, qint64 size)
+{
+    QSqlQuery query(db);
+    query.prepare("SELECT CACHE.DIGEST"
+                  " FROM FILES"
+                  " JOIN CACHE ON CACHE.DIGEST = FILES.DIGEST"
+                  " WHERE FILES.ID_FILE = ?"
+                  " AND FILES.ID_SERVER = ?"
+                  " AND CACHE.SIZE = ?");
+    query.addBindValue(id);
+    query.addBindValue(server);
+    query.addBindValue(size);
+
+    if (!query.exec())
+    {
+        Client::error(query.lastError().text());
+    }
+
+    if (!query.next())
+    {
+        return {};
+    }
+
+    auto digest = query.value(0).toByteArray();
+
+    if (!contains(digest))
+    {
+        return {};
+    }
+
+    touch(digest);
+
+    return getPath(digest);
+}
+
+void FileCache::insert(const QByteArray &digest, qint64 size)
+{
+    QSqlQuery query(db);
+    query.prepare("INSERT OR REPLACE INTO CACHE (DIGEST, SIZE, LAST_USED)"
+                  " VALUES (?, ?, ?)");
+    query.addBindValue(digest);
+    query.addBindValue(size);
+    query.addBindValue(QDateTime::currentMSecsSinceEpoch());
+
+    if (!query.exec())
+    {
+        Client::error(query.lastError().text());
+    }
+
+    evict();
+}
+
+void FileCache::touch(const QByteArray &digest)
+{
+    QSqlQuery query(db);
+    query.prepare("UPDATE CACHE"
+                  " SET LAST_USED = ?"
+                  " WHERE DIGEST = ?");
+    query.addBindValue(QDateTime::currentMSecsSinceEpoch());
+    query.addBindValue(digest);
+
+    if (!query.exec())
+    {
+        Client::error(query.lastError().text());
+    }
+}
+
+void FileCache::remove(const QByteArray &digest)
+{
+    QFile::remove(getPath(digest));
+
+    QSqlQuery query(db);
+    query.prepare("DELETE FROM CACHE"
+                  " WHERE DIGEST = ?");
+    query.addBindValue(digest);
+
+    if (!query.exec())
+    {
+        Client::error(query.lastError().text());
+    }
+}
+
+void FileCache::evict()
+{
+    QSqlQuery query(db);
+
+    if (!query.exec("SELECT DIGEST, SIZE"
+                    " FROM CACHE"
+                    " ORDER BY LAST_USED DESC"))
+    {
+        Client::error(query.lastError().text());
+    }
+
+    auto maxSize = getMaxSize();
+    qint64 total = 0;
+    QVector<QByteArray> evicted;
+
+    // Most recently used copies are kept while they fit
+    while (query.next())
+    {
+        total += query.value(1).toLongLong();
+
+        if (total > maxSize)
+        {
+            evicted.append(query.value(0).toByteArray());
+        }
+    }
+
+    for (const auto &digest : evicted)
+    {
+        remove(digest);
+    }
+}
@@ -0,0 +1,42 @@
+#ifndef FILECACHE_H
+#define FILECACHE_H
+
+#include <QByteArray>
+#include <QSqlDatabase>
+#include <QString>
+
+// Local copies of transferred files, named after their verified digests.
+//
+// The CACHE table keeps the size of every copy and when it was last used.
+// Copies are evicted least recently used first once they take more room
+// than Cache/MaxSize allows. A file is found by the id it had on a server
+// through the digests recorded in FILES.
+class FileCache
+{
+public:
+    explicit FileCache(const QSqlDatabase & = QSqlDatabase::database());
+
+    static constexpr qint64 DEFAULT_MAX_SIZE = 1024 * 1024 * 1024;
+
+    static qint64 getMaxSize();
+    static QString getPath(const QByteArray &);
+
+    // Copies a file into the cache under the digest, away from the database
+    static bool store(const QString &, const QByteArray &);
+
+    bool contains(const QByteArray &);
+
+    // Path of the cached copy of a file, empty if there is none
+    QString find(const QByteArray &, const QByteArray &, qint64);
+
+    void insert(const QByteArray &, qint64);
+
+private:
+    QSqlDatabase db;
+
+    void touch(const QByteArray &);
+    void remove(const QByteArray &);
+    void evict();
+};
+
+#endif // FILECACHE_H
@@ -0,0 +1,55 @@
+#include "framebuffer.h"
+
+#include <cstring>
+
+FrameBuffer::FrameBuffer(qint64 capacity)
+{
+    buffer.resize(int(capacity));
+}
+
+char *FrameBuffer::data()
+{
+    return buffer.data() + head;
+}
+
+qint64 FrameBuffer::size() const
+{
+    return tail - head;
+}
+
+char *FrameBuffer::reserve(qint64 length)
+{
+    if (buffer.size() - tail < length)
+    {
+        if (head > 0)
+        {
+            std::memmove(buffer.data(), buffer.constData() + head, size_t(size()));
+
+            tail -= head;
+            head = 0;
+        }
+
+        if (buffer.size() - tail < length)
+        {
+            buffer.resize(int(tail + length));
+        }
+    }
+
+    return buffer.data() + tail;
+}
+
+void FrameBuffer::commit(qint64 length)
+{
+    tail += length;
+}
+
+void FrameBuffer::consume(qint64 length)
+{
+    head += length;
+
+    if (head == tail)
+    {
+        head = 0;
+        tail = 0;
+    }
+}
@@ -0,0 +1,29 @@
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+#include <QByteArray>
+
+// Reusable receive buffer.
+//
+// Unread bytes are moved back to the front only when the free space at the
+// end is too small, so every frame stays contiguous and can be parsed and
+// decrypted in place without any per-frame allocation.
+class FrameBuffer
+{
+public:
+    explicit FrameBuffer(qint64);
+
+    char *data();
+    qint64 size() const;
+
+    char *reserve(qint64);
+    void commit(qint64);
+    void consume(qint64);
+
+private:
+    QByteArray buffer;
+    qint64 head = 0;
+    qint64 tail = 0;
+};
+
+#endif // FRAMEBUFFER_H
@@ -0,0 +1,40 @@
+#include "keyschedule.h"
+
+#include <cryptopp/hkdf.h>
+#include <cryptopp/sha.h>
+using CryptoPP::HKDF;
+using CryptoPP::SHA256;
+
+static const QByteArray RESUMPTION_LABEL = "neutron resumption secret";
+static const QByteArray RESUMED_LABEL = "neutron resumed secret";
+
+QVector<quint8> KeySchedule::resumptionSecret(const QVector<quint8> &secret)
+{
+    QVector<quint8> derived(SECRET_SIZE);
+
+    HKDF<SHA256>().DeriveKey(derived.data(), size_t(derived.size()),
+                             secret.constData(), size_t(secret.size()),
+                             nullptr, 0,
+                             reinterpret_cast<const quint8 *>(RESUMPTION_LABEL.constData()),
+                             size_t(RESUMPTION_LABEL.size()));
+
+    return derived;
+}
+
+QVector<quint8> KeySchedule::resumedSecret(const QVector<quint8> &secret,
+                                           const QByteArray &nonce,
+                                           const QByteArray &id,
+                                           const QVector<quint8> &public_key)
+{
+    QVector<quint8> derived(SECRET_SIZE);
+
+    auto info = RESUMED_LABEL + id;
+    info.append(reinterpret_cast<const char *>(public_key.constData()), public_key.size());
+
+    HKDF<SHA256>().DeriveKey(derived.data(), size_t(derived.size()),
+                             secret.constData(), size_t(secret.size()),
+                             reinterpret_cast<const quint8 *>(nonce.constData()), size_t(nonce.size()),
+                             reinterpret_cast<const quint8 *>(info.constData()), size_t(info.size()));
+
+    return derived;
+}
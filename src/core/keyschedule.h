@@ -0,0 +1,25 @@
+#ifndef KEYSCHEDULE_H
+#define KEYSCHEDULE_H
+
+#include <QByteArray>
+#include <QVector>
+
+// Secrets derived from the outcome of a key exchange
+namespace KeySchedule
+{
+static constexpr int SECRET_SIZE = 32;
+static constexpr int NONCE_SIZE = 32;
+
+// Kept by both sides for resuming the session later, never sent
+QVector<quint8> resumptionSecret(const QVector<quint8> &);
+
+// Shared secret of a resumed session. Binding the server id and the
+// ephemeral public key of this connection means the secret is useless
+// against any other server and can't be replayed on another connection.
+QVector<quint8> resumedSecret(const QVector<quint8> &,
+                              const QByteArray &,
+                              const QByteArray &,
+                              const QVector<quint8> &);
+}
+
+#endif // KEYSCHEDULE_H
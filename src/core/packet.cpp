@@ -2,11 +2,82 @@
 
 #include <QDataStream>
 
+QDataStream &operator<<(QDataStream &out, const Capabilities &d)
+{
+    out << d.encoding
+        << d.features
+        << d.max_frame_size;
+    return out;
+}
+
+QDataStream &operator>>(QDataStream &in, Capabilities &d)
+{
+    in >> d.encoding
+       >> d.features
+       >> d.max_frame_size;
+    return in;
+}
+
+CompactStream &operator<<(CompactStream &out, const Capabilities &d)
+{
+    out << d.encoding
+        << d.features
+        << d.max_frame_size;
+    return out;
+}
+
+CompactStream &operator>>(CompactStream &in, Capabilities &d)
+{
+    in >> d.encoding
+       >> d.features
+       >> d.max_frame_size;
+    return in;
+}
+
+QDataStream &operator<<(QDataStream &out, const Suite &d)
+{
+    out << d.kem
+        << d.signature
+        << d.kems;
+    return out;
+}
+
+QDataStream &operator>>(QDataStream &in, Suite &d)
+{
+    in >> d.kem
+       >> d.signature
+       >> d.kems;
+    return in;
+}
+
+CompactStream &operator<<(CompactStream &out, const Suite &d)
+{
+    out << d.kem
+        << d.signature
+        << d.kems;
+    return out;
+}
+
+CompactStream &operator>>(CompactStream &in, Suite &d)
+{
+    in >> d.kem
+       >> d.signature
+       >> d.kems;
+    return in;
+}
+
 QDataStream &operator<<(QDataStream &out, const ServerKeyExchange &d)
 {
     out << d.public_key[0]
         << d.public_key[1]
         << d.signature;
+
+    if (d.capabilities.encoding != Capabilities::Absent)
+    {
+        out << d.capabilities
+            << d.suite;
+    }
+
     return out;
 };
 
@@ -15,18 +86,167 @@ QDataStream &operator>>(QDataStream &in, ServerKeyExchange &d)
     in >> d.public_key[0]
        >> d.public_key[1]
        >> d.signature;
+
+    d.capabilities = {};
+    d.suite = {};
+
+    if (!in.atEnd())
+    {
+        in >> d.capabilities;
+    }
+
+    if (!in.atEnd())
+    {
+        in >> d.suite;
+    }
+
+    return in;
+}
+
+CompactStream &operator<<(CompactStream &out, const ServerKeyExchange &d)
+{
+    out << d.public_key[0]
+        << d.public_key[1]
+        << d.signature
+        << d.capabilities
+        << d.suite;
+    return out;
+}
+
+CompactStream &operator>>(CompactStream &in, ServerKeyExchange &d)
+{
+    in >> d.public_key[0]
+       >> d.public_key[1]
+       >> d.signature
+       >> d.capabilities
+       >> d.suite;
     return in;
 }
 
 QDataStream &operator<<(QDataStream &out, const ClientKeyExchange &d)
 {
     out << d.ciphertext;
+
+    if (d.capabilities.encoding != Capabilities::Absent)
+    {
+        out << d.capabilities;
+
+        // Servers that know nothing else expect no suite at all
+        auto original = d.suite.kem == Suite::SikeP751
+                        && d.suite.signature == Suite::Picnic2L5;
+
+        if (!d.ticket.isEmpty() || !original)
+        {
+            out << d.ticket
+                << d.nonce;
+        }
+
+        if (!original)
+        {
+            out << d.suite;
+        }
+    }
+
     return out;
 }
 
 QDataStream &operator>>(QDataStream &in, ClientKeyExchange &d)
 {
     in >> d.ciphertext;
+
+    d.capabilities = {};
+    d.ticket.clear();
+    d.nonce.clear();
+    d.suite = {};
+
+    if (!in.atEnd())
+    {
+        in >> d.capabilities;
+    }
+
+    if (!in.atEnd())
+    {
+        in >> d.ticket
+           >> d.nonce;
+    }
+
+    if (!in.atEnd())
+    {
+        in >> d.suite;
+    }
+
+    return in;
+}
+
+CompactStream &operator<<(CompactStream &out, const ClientKeyExchange &d)
+{
+    out << d.ciphertext
+        << d.capabilities
+        << d.ticket
+        << d.nonce
+        << d.suite;
+    return out;
+}
+
+CompactStream &operator>>(CompactStream &in, ClientKeyExchange &d)
+{
+    in >> d.ciphertext
+       >> d.capabilities
+       >> d.ticket
+       >> d.nonce
+       >> d.suite;
+    return in;
+}
+
+QDataStream &operator<<(QDataStream &out, const ReResumption &d)
+{
+    out << d.response;
+    return out;
+}
+
+QDataStream &operator>>(QDataStream &in, ReResumption &d)
+{
+    in >> d.response;
+    return in;
+}
+
+CompactStream &operator<<(CompactStream &out, const ReResumption &d)
+{
+    out << d.response;
+    return out;
+}
+
+CompactStream &operator>>(CompactStream &in, ReResumption &d)
+{
+    in >> d.response;
+    return in;
+}
+
+QDataStream &operator<<(QDataStream &out, const SessionTicket &d)
+{
+    out << d.ticket
+        << d.lifetime;
+    return out;
+}
+
+QDataStream &operator>>(QDataStream &in, SessionTicket &d)
+{
+    in >> d.ticket
+       >> d.lifetime;
+    return in;
+}
+
+CompactStream &operator<<(CompactStream &out, const SessionTicket &d)
+{
+    out << d.ticket
+        << d.lifetime;
+    return out;
+}
+
+CompactStream &operator>>(CompactStream &in, SessionTicket &d)
+{
+    in >> d.ticket
+       >> d.lifetime;
     return in;
 }
 
@@ -46,6 +266,22 @@ QDataStream &operator>>(QDataStream &in, RtAuthorization &d)
     return in;
 }
 
+CompactStream &operator<<(CompactStream &out, const RtAuthorization &d)
+{
+    out << d.username
+        << d.password
+        << d.request;
+    return out;
+}
+
+CompactStream &operator>>(CompactStream &in, RtAuthorization &d)
+{
+    in >> d.username
+       >> d.password
+       >> d.request;
+    return in;
+}
+
 QDataStream &operator<<(QDataStream &out, const ReAuthorization &d)
 {
     out << d.response
@@ -60,6 +296,20 @@ QDataStream &operator>>(QDataStream &in, ReAuthorization &d)
     return in;
 }
 
+CompactStream &operator<<(CompactStream &out, const ReAuthorization &d)
+{
+    out << d.response
+        << d.error;
+    return out;
+}
+
+CompactStream &operator>>(CompactStream &in, ReAuthorization &d)
+{
+    in >> d.response
+       >> d.error;
+    return in;
+}
+
 QDataStream &operator<<(QDataStream &out, const Room &d)
 {
     out << d.id
@@ -74,6 +324,20 @@ QDataStream &operator>>(QDataStream &in, Room &d)
     return in;
 }
 
+CompactStream &operator<<(CompactStream &out, const Room &d)
+{
+    out << fixedId(d.id)
+        << d.name;
+    return out;
+}
+
+CompactStream &operator>>(CompactStream &in, Room &d)
+{
+    in >> fixedId(d.id)
+       >> d.name;
+    return in;
+}
+
 QDataStream &operator<<(QDataStream &out, const Established &d)
 {
     out << d.name
@@ -90,15 +354,77 @@ QDataStream &operator>>(QDataStream &in, Established &d)
     return in;
 }
 
+CompactStream &operator<<(CompactStream &out, const Established &d)
+{
+    out << d.name
+        << d.motd
+        << d.rooms;
+    return out;
+}
+
+CompactStream &operator>>(CompactStream &in, Established &d)
+{
+    in >> d.name
+       >> d.motd
+       >> d.rooms;
+    return in;
+}
+
 QDataStream &operator<<(QDataStream &out, const Synchronize &d)
 {
     out << d.id_message;
+
+    if (d.limit)
+    {
+        out << d.cursor
+            << d.limit;
+    }
+
     return out;
 }
 
 QDataStream &operator>>(QDataStream &in, Synchronize &d)
 {
     in >> d.id_message;
+
+    d.cursor.clear();
+    d.limit = 0;
+
+    if (!in.atEnd())
+    {
+        in >> d.cursor
+           >> d.limit;
+    }
+
+    return in;
+}
+
+CompactStream &operator<<(CompactStream &out, const Synchronize &d)
+{
+    out << fixedId(d.id_message);
+
+    if (d.limit)
+    {
+        out << d.cursor
+            << d.limit;
+    }
+
+    return out;
+}
+
+CompactStream &operator>>(CompactStream &in, Synchronize &d)
+{
+    in >> fixedId(d.id_message);
+
+    d.cursor.clear();
+    d.limit = 0;
+
+    if (!in.atEnd())
+    {
+        in >> d.cursor
+           >> d.limit;
+    }
+
     return in;
 }
 
@@ -116,6 +442,20 @@ QDataStream &operator>>(QDataStream &in, UserState &d)
     return in;
 }
 
+CompactStream &operator<<(CompactStream &out, const UserState &d)
+{
+    out << d.id
+        << d.state;
+    return out;
+}
+
+CompactStream &operator>>(CompactStream &in, UserState &d)
+{
+    in >> d.id
+       >> d.state;
+    return in;
+}
+
 QDataStream &operator<<(QDataStream &out, const Message &d)
 {
     out << d.timestamp
@@ -134,6 +474,76 @@ QDataStream &operator>>(QDataStream &in, Message &d)
     return in;
 }
 
+CompactStream &operator<<(CompactStream &out, const Message &d)
+{
+    out << d.timestamp
+        << fixedId(d.id)
+        << d.id_sender
+        << d.content;
+    return out;
+}
+
+CompactStream &operator>>(CompactStream &in, Message &d)
+{
+    in >> d.timestamp
+       >> fixedId(d.id)
+       >> d.id_sender
+       >> d.content;
+    return in;
+}
+
+QDataStream &operator<<(QDataStream &out, const MessageBatch &d)
+{
+    out << d.messages;
+
+    if (!d.cursor.isEmpty())
+    {
+        out << d.cursor;
+    }
+
+    return out;
+}
+
+QDataStream &operator>>(QDataStream &in, MessageBatch &d)
+{
+    in >> d.messages;
+
+    d.cursor.clear();
+
+    if (!in.atEnd())
+    {
+        in >> d.cursor;
+    }
+
+    return in;
+}
+
+CompactStream &operator<<(CompactStream &out, const MessageBatch &d)
+{
+    out << d.messages;
+
+    if (!d.cursor.isEmpty())
+    {
+        out << d.cursor;
+    }
+
+    return out;
+}
+
+CompactStream &operator>>(CompactStream &in, MessageBatch &d)
+{
+    in >> d.messages;
+
+    d.cursor.clear();
+
+    if (!in.atEnd())
+    {
+        in >> d.cursor;
+    }
+
+    return in;
+}
+
 QDataStream &operator<<(QDataStream &out, const RtRoom &d)
 {
     out << d.id
@@ -148,6 +558,20 @@ QDataStream &operator>>(QDataStream &in, RtRoom &d)
     return in;
 }
 
+CompactStream &operator<<(CompactStream &out, const RtRoom &d)
+{
+    out << fixedId(d.id)
+        << d.request;
+    return out;
+}
+
+CompactStream &operator>>(CompactStream &in, RtRoom &d)
+{
+    in >> fixedId(d.id)
+       >> d.request;
+    return in;
+}
+
 QDataStream &operator<<(QDataStream &out, const ReRoom &d)
 {
     out << d.response;
@@ -160,11 +584,29 @@ QDataStream &operator>>(QDataStream &in, ReRoom &d)
     return in;
 }
 
+CompactStream &operator<<(CompactStream &out, const ReRoom &d)
+{
+    out << d.response;
+    return out;
+}
+
+CompactStream &operator>>(CompactStream &in, ReRoom &d)
+{
+    in >> d.response;
+    return in;
+}
+
 QDataStream &operator<<(QDataStream &out, const RtUpload &d)
 {
     out << d.id
         << d.size
         << d.request;
+
+    if (d.offset)
+    {
+        out << d.offset;
+    }
+
     return out;
 }
 
@@ -173,6 +615,44 @@ QDataStream &operator>>(QDataStream &in, RtUpload &d)
     in >> d.id
        >> d.size
        >> d.request;
+
+    d.offset = 0;
+
+    if (!in.atEnd())
+    {
+        in >> d.offset;
+    }
+
+    return in;
+}
+
+CompactStream &operator<<(CompactStream &out, const RtUpload &d)
+{
+    out << fixedId(d.id)
+        << d.size
+        << d.request;
+
+    if (d.offset)
+    {
+        out << d.offset;
+    }
+
+    return out;
+}
+
+CompactStream &operator>>(CompactStream &in, RtUpload &d)
+{
+    in >> fixedId(d.id)
+       >> d.size
+       >> d.request;
+
+    d.offset = 0;
+
+    if (!in.atEnd())
+    {
+        in >> d.offset;
+    }
+
     return in;
 }
 
@@ -192,10 +672,32 @@ QDataStream &operator>>(QDataStream &in, ReUpload &d)
     return in;
 }
 
+CompactStream &operator<<(CompactStream &out, const ReUpload &d)
+{
+    out << fixedId(d.id)
+        << d.response
+        << d.error;
+    return out;
+}
+
+CompactStream &operator>>(CompactStream &in, ReUpload &d)
+{
+    in >> fixedId(d.id)
+       >> d.response
+       >> d.error;
+    return in;
+}
+
 QDataStream &operator<<(QDataStream &out, const Upload &d)
 {
     out << d.id
         << d.chunkdata;
+
+    if (d.sequence)
+    {
+        out << d.sequence;
+    }
+
     return out;
 }
 
@@ -203,6 +705,42 @@ QDataStream &operator>>(QDataStream &in, Upload &d)
 {
     in >> d.id
        >> d.chunkdata;
+
+    d.sequence = 0;
+
+    if (!in.atEnd())
+    {
+        in >> d.sequence;
+    }
+
+    return in;
+}
+
+CompactStream &operator<<(CompactStream &out, const Upload &d)
+{
+    out << fixedId(d.id)
+        << d.chunkdata;
+
+    if (d.sequence)
+    {
+        out << d.sequence;
+    }
+
+    return out;
+}
+
+CompactStream &operator>>(CompactStream &in, Upload &d)
+{
+    in >> fixedId(d.id)
+       >> d.chunkdata;
+
+    d.sequence = 0;
+
+    if (!in.atEnd())
+    {
+        in >> d.sequence;
+    }
+
     return in;
 }
 
@@ -210,6 +748,17 @@ QDataStream &operator<<(QDataStream &out, const UploadState &d)
 {
     out << d.id
         << d.state;
+
+    if (d.sequence || !d.digest.isEmpty())
+    {
+        out << d.sequence;
+    }
+
+    if (!d.digest.isEmpty())
+    {
+        out << d.digest;
+    }
+
     return out;
 }
 
@@ -217,6 +766,59 @@ QDataStream &operator>>(QDataStream &in, UploadState &d)
 {
     in >> d.id
        >> d.state;
+
+    d.sequence = 0;
+    d.digest.clear();
+
+    if (!in.atEnd())
+    {
+        in >> d.sequence;
+    }
+
+    if (!in.atEnd())
+    {
+        in >> d.digest;
+    }
+
+    return in;
+}
+
+CompactStream &operator<<(CompactStream &out, const UploadState &d)
+{
+    out << fixedId(d.id)
+        << d.state;
+
+    if (d.sequence || !d.digest.isEmpty())
+    {
+        out << d.sequence;
+    }
+
+    if (!d.digest.isEmpty())
+    {
+        out << d.digest;
+    }
+
+    return out;
+}
+
+CompactStream &operator>>(CompactStream &in, UploadState &d)
+{
+    in >> fixedId(d.id)
+       >> d.state;
+
+    d.sequence = 0;
+    d.digest.clear();
+
+    if (!in.atEnd())
+    {
+        in >> d.sequence;
+    }
+
+    if (!in.atEnd())
+    {
+        in >> d.digest;
+    }
+
     return in;
 }
 
@@ -231,3 +833,15 @@ QDataStream &operator>>(QDataStream &in, Ping &d)
     in >> d.timestamp;
     return in;
 }
+
+CompactStream &operator<<(CompactStream &out, const Ping &d)
+{
+    out << d.timestamp;
+    return out;
+}
+
+CompactStream &operator>>(CompactStream &in, Ping &d)
+{
+    in >> d.timestamp;
+    return in;
+}
@@ -1,6 +1,9 @@
 #ifndef PACKET_H
 #define PACKET_H
 
+#include "compactstream.h"
+
+#include <QDataStream>
 #include <QMetaType>
 #include <QVector>
 
@@ -20,23 +23,135 @@ enum class PacketType
     Upload,
     UploadState,
     Ping,
-    Pong
+    Pong,
+    MessageBatch,
+    Resumption,
+    SessionTicket
+};
+
+// Protocol extensions, offered by the server and selected by the client.
+// Legacy servers send none, in which case the original framing is used.
+struct Capabilities
+{
+    enum Encoding
+    {
+        Absent,
+        Legacy,
+        Compact
+    };
+    enum Feature
+    {
+        LargeFrames = 0x1,
+        Compression = 0x2,
+        MessageBatches = 0x4,
+        PagedHistory = 0x8,
+        SessionKeys = 0x10,
+        Resumption = 0x20,
+        AesGcm = 0x40,
+        Windowed = 0x80,
+        AdaptiveChunks = 0x100,
+        ResumableTransfers = 0x200,
+        Digests = 0x400
+    };
+    Encoding encoding;
+    quint32 features;
+    quint32 max_frame_size;
+};
+QDataStream &operator<<(QDataStream &, const Capabilities &);
+QDataStream &operator>>(QDataStream &, Capabilities &);
+CompactStream &operator<<(CompactStream &, const Capabilities &);
+CompactStream &operator>>(CompactStream &, Capabilities &);
+
+// Post-quantum algorithms of the handshake. Servers that send none use SIKE
+// p751 and Picnic2 L5. The signature algorithm is the one of the key the
+// server id was made from, the key exchange is chosen by the server among
+// kems and the client may ask once for another one it accepts.
+struct Suite
+{
+    enum Kem
+    {
+        SikeP751,
+        Kyber512,
+        Kyber768,
+        Kyber1024,
+        MlKem768,
+        MlKem1024
+    };
+
+    enum Signature
+    {
+        Picnic2L5,
+        Dilithium2,
+        Dilithium3,
+        MlDsa65,
+        MlDsa87
+    };
+
+    Kem kem;
+    Signature signature;
+    quint32 kems;
 };
+QDataStream &operator<<(QDataStream &, const Suite &);
+QDataStream &operator>>(QDataStream &, Suite &);
+CompactStream &operator<<(CompactStream &, const Suite &);
+CompactStream &operator>>(CompactStream &, Suite &);
 
 struct ServerKeyExchange
 {
     QVector<quint8> public_key[2];
     QVector<quint8> signature;
+    Capabilities capabilities;
+    Suite suite;
 };
 QDataStream &operator<<(QDataStream &, const ServerKeyExchange &);
 QDataStream &operator>>(QDataStream &, ServerKeyExchange &);
+CompactStream &operator<<(CompactStream &, const ServerKeyExchange &);
+CompactStream &operator>>(CompactStream &, ServerKeyExchange &);
 
+// With a ticket and no ciphertext the client asks to resume an earlier
+// session instead of completing the key exchange. With neither it asks for
+// another ServerKeyExchange using the key exchange in suite.
 struct ClientKeyExchange
 {
     QVector<quint8> ciphertext;
+    Capabilities capabilities;
+    QByteArray ticket;
+    QByteArray nonce;
+    Suite suite;
 };
 QDataStream &operator<<(QDataStream &, const ClientKeyExchange &);
 QDataStream &operator>>(QDataStream &, ClientKeyExchange &);
+CompactStream &operator<<(CompactStream &, const ClientKeyExchange &);
+CompactStream &operator>>(CompactStream &, ClientKeyExchange &);
+
+// Answer to a resumption attempt, sent before either side switches keys.
+// When rejected the client completes the full key exchange on the same
+// connection.
+struct ReResumption
+{
+    enum Response
+    {
+        Accepted,
+        Rejected
+    };
+    Response response;
+};
+QDataStream &operator<<(QDataStream &, const ReResumption &);
+QDataStream &operator>>(QDataStream &, ReResumption &);
+CompactStream &operator<<(CompactStream &, const ReResumption &);
+CompactStream &operator>>(CompactStream &, ReResumption &);
+
+// Issued once the session is established. The ticket is opaque to the
+// client and may be redeemed for lifetime seconds.
+struct SessionTicket
+{
+    QByteArray ticket;
+    qint64 lifetime;
+};
+QDataStream &operator<<(QDataStream &, const SessionTicket &);
+QDataStream &operator>>(QDataStream &, SessionTicket &);
+CompactStream &operator<<(CompactStream &, const SessionTicket &);
+CompactStream &operator>>(CompactStream &, SessionTicket &);
 
 struct RtAuthorization
 {
@@ -51,6 +166,8 @@ struct RtAuthorization
 };
 QDataStream &operator<<(QDataStream &, const RtAuthorization &);
 QDataStream &operator>>(QDataStream &, RtAuthorization &);
+CompactStream &operator<<(CompactStream &, const RtAuthorization &);
+CompactStream &operator>>(CompactStream &, RtAuthorization &);
 
 struct ReAuthorization
 {
@@ -71,6 +188,8 @@ struct ReAuthorization
 };
 QDataStream &operator<<(QDataStream &, const ReAuthorization &);
 QDataStream &operator>>(QDataStream &, ReAuthorization &);
+CompactStream &operator<<(CompactStream &, const ReAuthorization &);
+CompactStream &operator>>(CompactStream &, ReAuthorization &);
 
 struct Room
 {
@@ -79,6 +198,8 @@ struct Room
 };
 QDataStream &operator<<(QDataStream &, const Room &);
 QDataStream &operator>>(QDataStream &, Room &);
+CompactStream &operator<<(CompactStream &, const Room &);
+CompactStream &operator>>(CompactStream &, Room &);
 
 struct Established
 {
@@ -88,13 +209,22 @@ struct Established
 };
 QDataStream &operator<<(QDataStream &, const Established &);
 QDataStream &operator>>(QDataStream &, Established &);
+CompactStream &operator<<(CompactStream &, const Established &);
+CompactStream &operator>>(CompactStream &, Established &);
 
+// With paged history the server answers with the newest page of at most
+// limit messages after id_message, and every MessageBatch carries the cursor
+// to pass back for the next older page.
 struct Synchronize
 {
     QByteArray id_message;
+    QByteArray cursor;
+    quint32 limit;
 };
 QDataStream &operator<<(QDataStream &, const Synchronize &);
 QDataStream &operator>>(QDataStream &, Synchronize &);
+CompactStream &operator<<(CompactStream &, const Synchronize &);
+CompactStream &operator>>(CompactStream &, Synchronize &);
 
 struct UserState
 {
@@ -108,6 +238,8 @@ struct UserState
 };
 QDataStream &operator<<(QDataStream &, const UserState &);
 QDataStream &operator>>(QDataStream &, UserState &);
+CompactStream &operator<<(CompactStream &, const UserState &);
+CompactStream &operator>>(CompactStream &, UserState &);
 
 struct Message
 {
@@ -118,6 +250,18 @@ struct Message
 };
 QDataStream &operator<<(QDataStream &, const Message &);
 QDataStream &operator>>(QDataStream &, Message &);
+CompactStream &operator<<(CompactStream &, const Message &);
+CompactStream &operator>>(CompactStream &, Message &);
+
+struct MessageBatch
+{
+    QVector<Message> messages;
+    QByteArray cursor;
+};
+QDataStream &operator<<(QDataStream &, const MessageBatch &);
+QDataStream &operator>>(QDataStream &, MessageBatch &);
+CompactStream &operator<<(CompactStream &, const MessageBatch &);
+CompactStream &operator>>(CompactStream &, MessageBatch &);
 
 struct RtRoom
 {
@@ -131,6 +275,8 @@ struct RtRoom
 };
 QDataStream &operator<<(QDataStream &, const RtRoom &);
 QDataStream &operator>>(QDataStream &, RtRoom &);
+CompactStream &operator<<(CompactStream &, const RtRoom &);
+CompactStream &operator>>(CompactStream &, RtRoom &);
 
 struct ReRoom
 {
@@ -143,7 +289,11 @@ struct ReRoom
 };
 QDataStream &operator<<(QDataStream &, const ReRoom &);
 QDataStream &operator>>(QDataStream &, ReRoom &);
+CompactStream &operator<<(CompactStream &, const ReRoom &);
+CompactStream &operator>>(CompactStream &, ReRoom &);
 
+// With resumable transfers offset is how much of the file the receiving side
+// already has, the transfer continues from there.
 struct RtUpload
 {
     enum Request
@@ -154,9 +304,12 @@ struct RtUpload
     QByteArray id;
     qint64 size;
     Request request;
+    qint64 offset;
 };
 QDataStream &operator<<(QDataStream &, const RtUpload &);
 QDataStream &operator>>(QDataStream &, RtUpload &);
+CompactStream &operator<<(CompactStream &, const RtUpload &);
+CompactStream &operator>>(CompactStream &, RtUpload &);
 
 struct ReUpload
 {
@@ -179,15 +332,25 @@ struct ReUpload
 };
 QDataStream &operator<<(QDataStream &, const ReUpload &);
 QDataStream &operator>>(QDataStream &, ReUpload &);
+CompactStream &operator<<(CompactStream &, const ReUpload &);
+CompactStream &operator>>(CompactStream &, ReUpload &);
 
+// With windowed transfers chunks are numbered from 1, and UploadState
+// acknowledges every chunk up to sequence at once.
 struct Upload
 {
     QByteArray id;
     QByteArray chunkdata;
+    quint32 sequence;
 };
 QDataStream &operator<<(QDataStream &, const Upload &);
 QDataStream &operator>>(QDataStream &, Upload &);
+CompactStream &operator<<(CompactStream &, const Upload &);
+CompactStream &operator>>(CompactStream &, Upload &);
 
+// With digests the receiving side puts the BLAKE2b digest of what it wrote
+// into Completed, and the sending side answers with a Completed carrying the
+// digest of what it read.
 struct UploadState
 {
     enum State
@@ -198,9 +361,13 @@ struct UploadState
     };
     QByteArray id;
     State state;
+    quint32 sequence;
+    QByteArray digest;
 };
 QDataStream &operator<<(QDataStream &, const UploadState &);
 QDataStream &operator>>(QDataStream &, UploadState &);
+CompactStream &operator<<(CompactStream &, const UploadState &);
+CompactStream &operator>>(CompactStream &, UploadState &);
 
 struct Ping
 {
@@ -208,23 +375,26 @@ struct Ping
 };
 QDataStream &operator<<(QDataStream &, const Ping &);
 QDataStream &operator>>(QDataStream &, Ping &);
+CompactStream &operator<<(CompactStream &, const Ping &);
+CompactStream &operator>>(CompactStream &, Ping &);
+
+DECLARE_ENUM_RANGE(Capabilities::Encoding, Capabilities::Compact)
+DECLARE_ENUM_RANGE(Suite::Kem, Suite::MlKem1024)
+DECLARE_ENUM_RANGE(Suite::Signature, Suite::MlDsa87)
+DECLARE_ENUM_RANGE(ReResumption::Response, ReResumption::Rejected)
+DECLARE_ENUM_RANGE(RtAuthorization::Request, RtAuthorization::Signup)
+DECLARE_ENUM_RANGE(ReAuthorization::Response, ReAuthorization::Authorized)
+DECLARE_ENUM_RANGE(ReAuthorization::Error, ReAuthorization::UserExists)
+DECLARE_ENUM_RANGE(UserState::State, UserState::Left)
+DECLARE_ENUM_RANGE(RtRoom::Request, RtRoom::Leave)
+DECLARE_ENUM_RANGE(ReRoom::Response, ReRoom::Left)
+DECLARE_ENUM_RANGE(RtUpload::Request, RtUpload::Transmit)
+DECLARE_ENUM_RANGE(ReUpload::Response, ReUpload::ReadyWrite)
+DECLARE_ENUM_RANGE(ReUpload::Error, ReUpload::NotFound)
+DECLARE_ENUM_RANGE(UploadState::State, UploadState::Completed)
+
+#undef DECLARE_ENUM_RANGE
 
-Q_DECLARE_METATYPE(PacketType)
-Q_DECLARE_METATYPE(ServerKeyExchange)
-Q_DECLARE_METATYPE(ClientKeyExchange)
-Q_DECLARE_METATYPE(RtAuthorization)
-Q_DECLARE_METATYPE(ReAuthorization)
-Q_DECLARE_METATYPE(Room)
-Q_DECLARE_METATYPE(Established)
-Q_DECLARE_METATYPE(Synchronize)
-Q_DECLARE_METATYPE(UserState)
 Q_DECLARE_METATYPE(Message)
-Q_DECLARE_METATYPE(RtRoom)
-Q_DECLARE_METATYPE(ReRoom)
-Q_DECLARE_METATYPE(RtUpload)
-Q_DECLARE_METATYPE(ReUpload)
-Q_DECLARE_METATYPE(Upload)
-Q_DECLARE_METATYPE(UploadState)
-Q_DECLARE_METATYPE(Ping)
 
 #endif // PACKET_H
@@ -0,0 +1,315 @@
+#include "pqcrypto.h"
+
+#include <QtEndian>
+
+#ifdef __cplusplus
+extern "C" {
+#include <oqs/oqs.h>
+}
+#endif
+
+static const char SUITE_LABEL[] = "neutron suite";
+
+// Lattice based algorithms are orders of magnitude faster than SIKE and Picnic
+static const Suite::Kem KEM_PREFERENCE[] =
+{
+    Suite::MlKem768,
+    Suite::Kyber768,
+    Suite::MlKem1024,
+    Suite::Kyber1024,
+    Suite::Kyber512,
+    Suite::SikeP751
+};
+
+static const Suite::Signature SIGNATURE_PREFERENCE[] =
+{
+    Suite::MlDsa65,
+    Suite::Dilithium3,
+    Suite::MlDsa87,
+    Suite::Dilithium2,
+    Suite::Picnic2L5
+};
+
+static const char *algorithm(Suite::Kem kem)
+{
+    switch (kem)
+    {
+    #ifdef OQS_KEM_alg_sike_p751
+    case Suite::SikeP751:
+        return OQS_KEM_alg_sike_p751;
+    #endif
+    #ifdef OQS_KEM_alg_kyber_512
+    case Suite::Kyber512:
+        return OQS_KEM_alg_kyber_512;
+    #endif
+    #ifdef OQS_KEM_alg_kyber_768
+    case Suite::Kyber768:
+        return OQS_KEM_alg_kyber_768;
+    #endif
+    #ifdef OQS_KEM_alg_kyber_1024
+    case Suite::Kyber1024:
+        return OQS_KEM_alg_kyber_1024;
+    #endif
+    #ifdef OQS_KEM_alg_ml_kem_768
+    case Suite::MlKem768:
+        return OQS_KEM_alg_ml_kem_768;
+    #endif
+    #ifdef OQS_KEM_alg_ml_kem_1024
+    case Suite::MlKem1024:
+        return OQS_KEM_alg_ml_kem_1024;
+    #endif
+    default:
+        return nullptr;
+    }
+}
+
+static const char *algorithm(Suite::Signature signature)
+{
+    switch (signature)
+    {
+    #ifdef OQS_SIG_alg_picnic2_L5_FS
+    case Suite::Picnic2L5:
+        return OQS_SIG_alg_picnic2_L5_FS;
+    #endif
+    #ifdef OQS_SIG_alg_dilithium_2
+    case Suite::Dilithium2:
+        return OQS_SIG_alg_dilithium_2;
+    #endif
+    #ifdef OQS_SIG_alg_dilithium_3
+    case Suite::Dilithium3:
+        return OQS_SIG_alg_dilithium_3;
+    #endif
+    #ifdef OQS_SIG_alg_ml_dsa_65
+    case Suite::MlDsa65:
+        return OQS_SIG_alg_ml_dsa_65;
+    #endif
+    #ifdef OQS_SIG_alg_ml_dsa_87
+    case Suite::MlDsa87:
+        return OQS_SIG_alg_ml_dsa_87;
+    #endif
+    default:
+        return nullptr;
+    }
+}
+
+KeyEncapsulation::KeyEncapsulation(Suite::Kem kem)
+    : kem(algorithm(kem) ? OQS_KEM_new(algorithm(kem)) : nullptr)
+{
+}
+
+KeyEncapsulation::~KeyEncapsulation()
+{
+    OQS_KEM_free(kem);
+}
+
+QVector<Suite::Kem> KeyEncapsulation::available()
+{
+    QVector<Suite::Kem> kems;
+
+    for (auto kem : KEM_PREFERENCE)
+    {
+        if (KeyEncapsulation(kem).isAvailable())
+        {
+            kems.append(kem);
+        }
+    }
+
+    return kems;
+}
+
+QString KeyEncapsulation::getName(Suite::Kem kem)
+{
+    return algorithm(kem);
+}
+
+bool KeyEncapsulation::fromName(const QString &name, Suite::Kem &kem)
+{
+    for (auto candidate : KEM_PREFERENCE)
+    {
+        if (algorithm(candidate) && name.compare(algorithm(candidate), Qt::CaseInsensitive) == 0)
+        {
+            kem = candidate;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool KeyEncapsulation::isAvailable() const
+{
+    return kem;
+}
+
+bool KeyEncapsulation::generate(QVector<quint8> &public_key, QVector<quint8> &secret_key) const
+{
+    if (!kem)
+    {
+        return false;
+    }
+
+    public_key.resize(int(kem->length_public_key));
+    secret_key.resize(int(kem->length_secret_key));
+
+    return OQS_KEM_keypair(kem, public_key.data(), secret_key.data()) == OQS_SUCCESS;
+}
+
+bool KeyEncapsulation::encapsulate(const QVector<quint8> &public_key,
+                                   QVector<quint8> &ciphertext,
+                                   QVector<quint8> &shared_secret) const
+{
+    if (!kem || size_t(public_key.size()) != kem->length_public_key)
+    {
+        return false;
+    }
+
+    ciphertext.resize(int(kem->length_ciphertext));
+    shared_secret.resize(int(kem->length_shared_secret));
+
+    return OQS_KEM_encaps(kem, ciphertext.data(), shared_secret.data(), public_key.constData()) == OQS_SUCCESS;
+}
+
+bool KeyEncapsulation::decapsulate(const QVector<quint8> &ciphertext,
+                                   const QVector<quint8> &secret_key,
+                                   QVector<quint8> &shared_secret) const
+{
+    if (!kem
+            || size_t(ciphertext.size()) != kem->length_ciphertext
+            || size_t(secret_key.size()) != kem->length_secret_key)
+    {
+        return false;
+    }
+
+    shared_secret.resize(int(kem->length_shared_secret));
+
+    return OQS_KEM_decaps(kem, shared_secret.data(), ciphertext.constData(), secret_key.constData()) == OQS_SUCCESS;
+}
+
+DigitalSignature::DigitalSignature(Suite::Signature signature)
+    : sig(algorithm(signature) ? OQS_SIG_new(algorithm(signature)) : nullptr)
+{
+}
+
+DigitalSignature::~DigitalSignature()
+{
+    OQS_SIG_free(sig);
+}
+
+QVector<Suite::Signature> DigitalSignature::available()
+{
+    QVector<Suite::Signature> signatures;
+
+    for (auto signature : SIGNATURE_PREFERENCE)
+    {
+        if (DigitalSignature(signature).isAvailable())
+        {
+            signatures.append(signature);
+        }
+    }
+
+    return signatures;
+}
+
+QByteArray DigitalSignature::content(const Suite &suite, const QVector<quint8> &public_key)
+{
+    QByteArray content;
+
+    if (suite.kem != Suite::SikeP751 || suite.signature != Suite::Picnic2L5)
+    {
+        content.append(SUITE_LABEL);
+
+        for (auto value : { quint32(suite.kem), quint32(suite.signature), suite.kems })
+        {
+            quint8 buffer[sizeof(quint32)];
+            qToBigEndian(value, buffer);
+
+            content.append(reinterpret_cast<const char *>(buffer), sizeof(buffer));
+        }
+    }
+
+    content.append(reinterpret_cast<const char *>(public_key.constData()), public_key.size());
+
+    return content;
+}
+
+QString DigitalSignature::getName(Suite::Signature signature)
+{
+    return algorithm(signature);
+}
+
+bool DigitalSignature::fromName(const QString &name, Suite::Signature &signature)
+{
+    for (auto candidate : SIGNATURE_PREFERENCE)
+    {
+        if (algorithm(candidate) && name.compare(algorithm(candidate), Qt::CaseInsensitive) == 0)
+        {
+            signature = candidate;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool DigitalSignature::isAvailable() const
+{
+    return sig;
+}
+
+bool DigitalSignature::generate(QVector<quint8> &public_key, QVector<quint8> &secret_key) const
+{
+    if (!sig)
+    {
+        return false;
+    }
+
+    public_key.resize(int(sig->length_public_key));
+    secret_key.resize(int(sig->length_secret_key));
+
+    return OQS_SIG_keypair(sig, public_key.data(), secret_key.data()) == OQS_SUCCESS;
+}
+
+bool DigitalSignature::sign(const QByteArray &message,
+                            const QVector<quint8> &secret_key,
+                            QVector<quint8> &signature) const
+{
+    if (!sig || size_t(secret_key.size()) != sig->length_secret_key)
+    {
+        return false;
+    }
+
+    size_t length;
+    signature.resize(int(sig->length_signature));
+
+    if (OQS_SIG_sign(sig,
+                     signature.data(),
+                     &length,
+                     reinterpret_cast<const quint8 *>(message.constData()),
+                     size_t(message.size()),
+                     secret_key.constData()) != OQS_SUCCESS)
+    {
+        return false;
+    }
+
+    signature.resize(int(length));
+    return true;
+}
+
+bool DigitalSignature::verify(const QByteArray &message,
+                              const QVector<quint8> &signature,
+                              const QVector<quint8> &public_key) const
+{
+    if (!sig
+            || size_t(public_key.size()) != sig->length_public_key
+            || size_t(signature.size()) > sig->length_signature)
+    {
+        return false;
+    }
+
+    return OQS_SIG_verify(sig,
+                          reinterpret_cast<const quint8 *>(message.constData()),
+                          size_t(message.size()),
+                          signature.constData(),
+                          size_t(signature.size()),
+                          public_key.constData()) == OQS_SUCCESS;
+}
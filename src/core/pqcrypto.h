@@ -0,0 +1,68 @@
+#ifndef PQCRYPTO_H
+#define PQCRYPTO_H
+
+#include "packet.h"
+
+struct OQS_KEM;
+struct OQS_SIG;
+
+// liboqs algorithms of the handshake suites.
+//
+// They are looked up at run time, so a liboqs build lacking some of them
+// still works with the others. Every input is checked against the lengths
+// the algorithm expects before it reaches liboqs.
+class KeyEncapsulation
+{
+public:
+    explicit KeyEncapsulation(Suite::Kem);
+    ~KeyEncapsulation();
+
+    // Available algorithms, the preferred one first
+    static QVector<Suite::Kem> available();
+
+    // liboqs names
+    static QString getName(Suite::Kem);
+    static bool fromName(const QString &, Suite::Kem &);
+
+    bool isAvailable() const;
+
+    bool generate(QVector<quint8> &, QVector<quint8> &) const;
+    bool encapsulate(const QVector<quint8> &, QVector<quint8> &, QVector<quint8> &) const;
+    bool decapsulate(const QVector<quint8> &, const QVector<quint8> &, QVector<quint8> &) const;
+
+private:
+    OQS_KEM *kem;
+
+    Q_DISABLE_COPY(KeyEncapsulation)
+};
+
+class DigitalSignature
+{
+public:
+    explicit DigitalSignature(Suite::Signature);
+    ~DigitalSignature();
+
+    // Available algorithms, the preferred one first
+    static QVector<Suite::Signature> available();
+
+    // liboqs names
+    static QString getName(Suite::Signature);
+    static bool fromName(const QString &, Suite::Signature &);
+
+    // What the server signs: the ephemeral public key alone with the
+    // original suite, otherwise the suite as well so it can't be downgraded
+    static QByteArray content(const Suite &, const QVector<quint8> &);
+
+    bool isAvailable() const;
+
+    bool generate(QVector<quint8> &, QVector<quint8> &) const;
+    bool sign(const QByteArray &, const QVector<quint8> &, QVector<quint8> &) const;
+    bool verify(const QByteArray &, const QVector<quint8> &, const QVector<quint8> &) const;
+
+private:
+    OQS_SIG *sig;
+
+    Q_DISABLE_COPY(DigitalSignature)
+};
+
+#endif // PQCRYPTO_H
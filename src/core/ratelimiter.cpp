@@ -0,0 +1,62 @@
+#include "ratelimiter.h"
+
+#include <cmath>
+
+constexpr qint64 RateLimiter::BURST_DURATION;
+
+RateLimiter::RateLimiter(qint64 rate)
+    : rate(0)
+    , tokens(0)
+{
+    clock.start();
+    setRate(rate);
+}
+
+qint64 RateLimiter::getRate() const
+{
+    return rate;
+}
+
+void RateLimiter::setRate(qint64 rate)
+{
+    this->rate = qMax<qint64>(rate, 0);
+
+    // A new limit starts with a full bucket and forgets earlier debt
+    tokens = double(this->rate) * BURST_DURATION / 1000;
+    clock.restart();
+}
+
+qint64 RateLimiter::getDelay()
+{
+    if (!rate)
+    {
+        return 0;
+    }
+
+    refill();
+
+    return tokens > 0
+           ? 0
+           : qint64(std::ceil(-tokens * 1000 / rate)) + 1;
+}
+
+void RateLimiter::consume(qint64 bytes)
+{
+    if (!rate)
+    {
+        return;
+    }
+
+    refill();
+
+    tokens -= bytes;
+}
+
+void RateLimiter::refill()
+{
+    auto elapsed = clock.nsecsElapsed();
+    clock.restart();
+
+    tokens = qMin(tokens + double(rate) * elapsed / 1000000000,
+                  double(rate) * BURST_DURATION / 1000);
+}
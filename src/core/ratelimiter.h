@@ -0,0 +1,36 @@
+#ifndef RATELIMITER_H
+#define RATELIMITER_H
+
+#include <QElapsedTimer>
+
+// Token bucket holding transfers to a rate in bytes per second.
+//
+// The bucket fills at the rate, up to BURST_DURATION worth of it. Chunks
+// pass whenever there is anything in it and may take it into debt, so that
+// a chunk larger than the bucket still goes through, only paid for later.
+class RateLimiter
+{
+public:
+    explicit RateLimiter(qint64 = 0);
+
+    // In milliseconds, like the delays
+    static constexpr qint64 BURST_DURATION = 100;
+
+    // None without a limit
+    qint64 getRate() const;
+    void setRate(qint64);
+
+    // Milliseconds until chunks may pass again, none if they may now
+    qint64 getDelay();
+    void consume(qint64);
+
+private:
+    QElapsedTimer clock;
+
+    qint64 rate;
+    double tokens;
+
+    void refill();
+};
+
+#endif // RATELIMITER_H
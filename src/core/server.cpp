@@ -1,36 +1,84 @@
 #include "server.h"
 #include "client.h"
 #include "file.h"
+#include "filecache.h"
+#include "keyschedule.h"
+#include "pqcrypto.h"
 
 #include <QDateTime>
 #include <QSqlError>
 #include <QSqlQuery>
 #include <QUuid>
+#include <QtConcurrent>
+
+#include <climits>
+#include <type_traits>
 
 #include <cryptopp/filters.h>
+#include <cryptopp/osrng.h>
 #include <cryptopp/sha3.h>
 using CryptoPP::ArraySink;
 using CryptoPP::ArraySource;
 using CryptoPP::HashFilter;
 using CryptoPP::SHA3_512;
 
-#ifdef __cplusplus
-extern "C" {
-#include <oqs/oqs.h>
-}
-#endif
+// Room left in an Upload frame for the packet envelope and the file id
+static constexpr qint64 UPLOAD_OVERHEAD = 256;
+// Payloads shorter than this, or compressing by fewer bytes, are sent as is
+static constexpr qint64 DEFAULT_COMPRESSION_THRESHOLD = 64;
+// Messages per page of paged history
+static constexpr quint32 DEFAULT_HISTORY_PAGE_SIZE = 100;
+// Tickets are kept no longer than this, whatever the server says
+static constexpr qint64 MAX_TICKET_LIFETIME = 7 * 24 * 60 * 60;
+// Progress of resumable transfers is saved at most this often
+static constexpr int CHECKPOINT_INTERVAL = 1000;
+// Unfinished transfers are forgotten after this long without progress
+static constexpr qint64 TRANSFER_LIFETIME = 7 * 24 * 60 * 60;
+// Acknowledgements of downloads are held back no longer than this while
+// nothing arrives, in msecs
+static constexpr qint64 STALL_TIMEOUT = 1000;
+
+QHash<QByteArray, Server::Ticket> Server::tickets;
 
 Server::Server()
-    : interruptionRequested(false)
+    : chunkSize(File::PAGE_SIZE)
+    , pagedHistory(false)
+    , historyPageSize(DEFAULT_HISTORY_PAGE_SIZE)
+    , history(History::Idle)
+    , historyRequested(false)
+    , windowLimit(0)
+    , adaptiveChunks(false)
+    , resumableTransfers(false)
+    , digests(false)
+    , uploadLimiter(Client::getSettings().value("Network/UploadLimit", 0).toLongLong())
+    , downloadLimiter(Client::getSettings().value("Network/DownloadLimit", 0).toLongLong())
+    , interruptionRequested(false)
     , reading(false)
     , writing(false)
-    , encryption(false)
-    , shared_secret(OQS_KEM_sike_p751_length_shared_secret)
+    , capabilities()
+    , suite()
+    , retried(false)
 {
+    transport = new Transport(this);
+    transport->setPipelineThread(Client::getPipelineThread());
+
+    connect(transport, &Transport::readyRead,
+            this, &Server::onReadyRead);
+
+    verification = new QFutureWatcher<bool>(this);
+    encapsulation = new QFutureWatcher<Encapsulation>(this);
+
+    connect(verification, &QFutureWatcherBase::finished,
+            this, &Server::onKeysExchanged);
+    connect(encapsulation, &QFutureWatcherBase::finished,
+            this, &Server::onKeysExchanged);
 }
 
 Server::~Server()
 {
+    // Whatever was confirmed until the connection dropped is kept
+    checkpoint();
+
     socket->disconnect(this);
     socket->deleteLater();
     db.close();
@@ -39,7 +87,7 @@ Server::~Server()
 void Server::run(QTcpSocket *socket, QString id, QString username, QString password, bool signup)
 {
     this->socket = socket;
-    stream.setDevice(socket);
+    transport->setSocket(socket);
 
     this->username = username;
     this->password = password;
@@ -50,6 +98,8 @@ void Server::run(QTcpSocket *socket, QString id, QString username, QString passw
     db = QSqlDatabase::cloneDatabase(QLatin1String(QSqlDatabase::defaultConnection), {});
     db.open();
 
+    socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+
     connect(socket, &QTcpSocket::disconnected,
             this, &Server::onDisconnected);
     connect(socket, &QTcpSocket::readyRead,
@@ -62,6 +112,21 @@ void Server::run(QTcpSocket *socket, QString id, QString username, QString passw
     });
     disconnectTimer->setInterval(35000);
     disconnectTimer->start();
+
+    // Frames produced during one event loop turn are written together
+    flushTimer = new QTimer(this);
+    flushTimer->callOnTimeout(this, &Server::flush);
+    flushTimer->setInterval(0);
+    flushTimer->setSingleShot(true);
+
+    checkpointTimer = new QTimer(this);
+    checkpointTimer->callOnTimeout(this, &Server::checkpoint);
+    checkpointTimer->setInterval(CHECKPOINT_INTERVAL);
+
+    // Transfers held to the bandwidth limits go on once the buckets refill
+    paceTimer = new QTimer(this);
+    paceTimer->callOnTimeout(this, &Server::pace);
+    paceTimer->setSingleShot(true);
 }
 
 void Server::close(QString reason)
@@ -71,6 +136,7 @@ void Server::close(QString reason)
         emit print(reason);
     }
 
+    flush();
     socket->close();
 }
 
@@ -103,583 +169,1716 @@ void Server::onReadyRead()
 
     reading = true;
 
-    while (!socket->atEnd())
+    // Frames may be waiting from the pipeline before anything is received
+    do
     {
-        stream.startTransaction();
-
         quint8 type;
-        quint16 length;
-        stream >> type >> length;
+        auto status = Transport::Incomplete;
 
-        QByteArray in;
-        QVector<quint8> crypto[2];
-
-        if (length > 0)
+        while (socket->isOpen()
+                && (status = transport->next(type)) == Transport::Ok)
         {
-            in.resize(length);
-
-            if (encryption)
+            if (!handle(type))
             {
-                crypto[0].resize(dec.DigestSize());
-                crypto[1].resize(dec.DefaultIVLength());
-
-                stream.readRawData(reinterpret_cast<char *>(crypto[0].data()), crypto[0].size());
-                stream.readRawData(reinterpret_cast<char *>(crypto[1].data()), crypto[1].size());
+                close("Failed to deserialize incoming packet");
+                break;
             }
-
-            stream.readRawData(in.data(), in.size());
         }
 
-        if (!stream.commitTransaction())
+        if (status == Transport::Error)
         {
+            close(transport->getError());
             break;
         }
+    }
+    while (socket->isOpen() && transport->receive());
 
-        QVariant v;
+    reading = false;
+    emit read();
+}
 
-        if (length > 0)
-        {
-            if (encryption)
-            {
-                dec.SetKeyWithIV(shared_secret.constData(),
-                                 shared_secret.size(),
-                                 crypto[1].constData(),
-                                 crypto[1].size());
-
-                if (!dec.DecryptAndVerify(reinterpret_cast<quint8 *>(in.data()),
-                                          crypto[0].constData(),
-                                          crypto[0].size(),
-                                          crypto[1].constData(),
-                                          crypto[1].size(),
-                                          nullptr,
-                                          0,
-                                          reinterpret_cast<const quint8 *>(in.constData()), in.size()))
-                {
-                    close(tr("Failed to decrypt incoming packet"));
-                    break;
-                }
-            }
+bool Server::handle(quint8 type)
+{
+    bool ok = true;
 
-            QDataStream ds(&in, QIODevice::ReadOnly);
-            v.load(ds);
+    if (!transport->isEncrypted())
+    {
+        switch (type)
+        {
+        case quint8(PacketType::Handshake):
+        {
+            ok = dispatch<PacketType::Handshake>(&Server::doHandshake);
         }
+        break;
 
-        bool ok = true;
-
-        if (!encryption)
+        case quint8(PacketType::Resumption):
         {
-            switch (type)
-            {
-            case quint8(PacketType::Handshake):
-            {
-                if ((ok = v.canConvert<ServerKeyExchange>()))
-                {
-                    doHandshake(v.value<ServerKeyExchange>());
-                }
-            }
-            break;
-            }
+            ok = dispatch<PacketType::Resumption>(&Server::doResumption);
         }
-        else
+        break;
+        }
+    }
+    else
+    {
+        switch (type)
         {
-            switch (type)
-            {
-            case quint8(PacketType::ReAuthorization):
-            {
-                if ((ok = v.canConvert<ReAuthorization>()))
-                {
-                    doReAuthorization(v.value<ReAuthorization>());
-                }
-            }
-            break;
+        case quint8(PacketType::ReAuthorization):
+        {
+            ok = dispatch<PacketType::ReAuthorization>(&Server::doReAuthorization);
+        }
+        break;
 
-            case quint8(PacketType::Established):
-            {
-                if ((ok = v.canConvert<Established>()))
-                {
-                    doEstablished(v.value<Established>());
-                }
-            }
-            break;
+        case quint8(PacketType::Established):
+        {
+            ok = dispatch<PacketType::Established>(&Server::doEstablished);
+        }
+        break;
 
-            case quint8(PacketType::UserState):
-            {
-                if ((ok = v.canConvert<UserState>()))
-                {
-                    doUserState(v.value<UserState>());
-                }
-            }
-            break;
+        case quint8(PacketType::SessionTicket):
+        {
+            ok = dispatch<PacketType::SessionTicket>(&Server::doSessionTicket);
+        }
+        break;
 
-            case quint8(PacketType::Message):
-            {
-                if ((ok = v.canConvert<Message>()))
-                {
-                    doMessage(v.value<Message>());
-                }
-            }
-            break;
+        case quint8(PacketType::UserState):
+        {
+            ok = dispatch<PacketType::UserState>(&Server::doUserState);
+        }
+        break;
 
-            case quint8(PacketType::ReRoom):
-            {
-                if ((ok = v.canConvert<ReRoom>()))
-                {
-                    doReRoom(v.value<ReRoom>());
-                }
-            }
-            break;
+        case quint8(PacketType::Message):
+        {
+            ok = dispatch<PacketType::Message>(&Server::doMessage);
+        }
+        break;
 
-            case quint8(PacketType::ReUpload):
-            {
-                if ((ok = v.canConvert<ReUpload>()))
-                {
-                    doReUpload(v.value<ReUpload>());
-                }
-            }
-            break;
+        case quint8(PacketType::MessageBatch):
+        {
+            ok = dispatch<PacketType::MessageBatch>(&Server::doMessageBatch);
+        }
+        break;
 
-            case quint8(PacketType::Upload):
-            {
-                if ((ok = v.canConvert<Upload>()))
-                {
-                    doUpload(v.value<Upload>());
-                }
-            }
-            break;
+        case quint8(PacketType::ReRoom):
+        {
+            ok = dispatch<PacketType::ReRoom>(&Server::doReRoom);
+        }
+        break;
 
-            case quint8(PacketType::UploadState):
-            {
-                if ((ok = v.canConvert<UploadState>()))
-                {
-                    doUploadState(v.value<UploadState>());
-                }
-            }
-            break;
+        case quint8(PacketType::ReUpload):
+        {
+            ok = dispatch<PacketType::ReUpload>(&Server::doReUpload);
+        }
+        break;
 
-            case quint8(PacketType::Ping):
-            {
-                if ((ok = v.canConvert<Ping>()))
-                {
-                    doPing(v.value<Ping>());
-                }
-            }
-            break;
-            }
+        case quint8(PacketType::Upload):
+        {
+            ok = dispatch<PacketType::Upload>(&Server::doUpload);
+        }
+        break;
 
-            if (!ok)
-            {
-                close("Failed to deserialize incoming packet");
-                break;
-            }
+        case quint8(PacketType::UploadState):
+        {
+            ok = dispatch<PacketType::UploadState>(&Server::doUploadState);
+        }
+        break;
+
+        case quint8(PacketType::Ping):
+        {
+            ok = dispatch<PacketType::Ping>(&Server::doPing);
+        }
+        break;
         }
     }
 
-    reading = false;
-    emit read();
+    return ok;
 }
 
 void Server::doHandshake(ServerKeyExchange d)
 {
-    QByteArray id;
-
-    SHA3_512 hash;
-    id.resize(hash.DigestSize());
-
-    ArraySource(d.public_key->constData(),
-                d.public_key->size(), true,
-                new HashFilter(
-                    hash,
-                    new ArraySink(reinterpret_cast<quint8 *>(id.data()), id.size())
-                ));
-
-    if (id != this->id)
+    if (!handshake.public_key[1].isEmpty())
     {
-        close(tr("Server signature public key verification failed"));
+        close(tr("Server sent invalid data"));
         return;
     }
 
+    // Servers without capabilities only know the original suite
+    if (d.capabilities.encoding == Capabilities::Absent)
+    {
+        d.suite =
+        {
+            Suite::SikeP751,
+            Suite::Picnic2L5,
+            1u << Suite::SikeP751
+        };
+    }
 
-    OQS_STATUS rc;
-
-    rc = OQS_SIG_picnic2_L5_FS_verify(d.public_key[1].constData(),
-                                      d.public_key[1].size(),
-                                      d.signature.constData(),
-                                      d.signature.size(),
-                                      d.public_key[0].constData());
-
-    if (rc != OQS_SUCCESS)
+    // A second ServerKeyExchange answers the request for another key exchange
+    if (retried && (d.suite.kem != suite.kem || d.suite.signature != suite.signature))
     {
-        close(tr("Server ephemeral public key verification failed"));
+        close(tr("Server sent invalid data"));
         return;
     }
 
-    QVector<quint8> ciphertext(OQS_KEM_sike_p751_length_ciphertext);
+    handshake = d;
+    suite = d.suite;
+    capabilities = {};
 
-    rc = OQS_KEM_sike_p751_encaps(ciphertext.data(),
-                                  shared_secret.data(),
-                                  d.public_key[1].constData());
-
-    if (rc != OQS_SUCCESS)
+    if (d.capabilities.encoding != Capabilities::Absent)
     {
-        close(tr("Failed to reach shared secret"));
-        return;
+        capabilities.encoding = qMin(d.capabilities.encoding, Capabilities::Compact);
     }
 
-    sendOne(PacketType::Handshake, QVariant::fromValue(
-                ClientKeyExchange
+    if (d.capabilities.features & Capabilities::LargeFrames)
     {
-        ciphertext
-    }));
-
-    encryption = true;
+        auto limit = qBound(Transport::LEGACY_FRAME_SIZE,
+                            Client::getSettings().value("Network/MaxFrameSize",
+                                                        Transport::DEFAULT_FRAME_SIZE).toUInt(),
+                            Transport::MAX_FRAME_SIZE);
 
-    sendOne(PacketType::RtAuthorization, QVariant::fromValue(
-                RtAuthorization
-    {
-        username.toUtf8(),
-        password.toUtf8(),
-        signup
-        ? RtAuthorization::Signup
-        : RtAuthorization::Signin
-    }));
-}
+        capabilities.features |= Capabilities::LargeFrames;
+        capabilities.max_frame_size = qBound(Transport::LEGACY_FRAME_SIZE, d.capabilities.max_frame_size, limit);
+    }
 
-void Server::doReAuthorization(ReAuthorization d)
-{
-    switch (d.error)
-    {
-    case ReAuthorization::InvalidUsername:
+    if (d.capabilities.features & Capabilities::MessageBatches)
     {
-        close(tr("No user found with this username"));
+        capabilities.features |= Capabilities::MessageBatches;
     }
-    break;
 
-    case ReAuthorization::InvalidPassword:
+    if (d.capabilities.features & Capabilities::PagedHistory)
     {
-        close(tr("You entered the wrong password"));
+        capabilities.features |= Capabilities::PagedHistory;
     }
-    break;
 
-    case ReAuthorization::UserExists:
+    if (d.capabilities.features & Capabilities::SessionKeys)
     {
-        close(tr("Username already taken"));
-    }
-    break;
+        capabilities.features |= Capabilities::SessionKeys;
 
-    default:
-        ;
+        // Only worth it where AES-GCM runs in hardware, ChaCha20 wins elsewhere
+        if (d.capabilities.features & Capabilities::AesGcm
+                && SessionCipher::isAesAccelerated())
+        {
+            capabilities.features |= Capabilities::AesGcm;
+        }
     }
-}
 
-void Server::doEstablished(Established d)
-{
-    emit print(tr("Connected"));
+    if (d.capabilities.features & Capabilities::Windowed
+            && Client::getSettings().value("Network/TransferWindow",
+                                           TransferWindow::DEFAULT_LIMIT).toUInt() > 1)
+    {
+        capabilities.features |= Capabilities::Windowed;
 
-    QSqlQuery query(db);
-    query.prepare("INSERT OR REPLACE INTO SERVERS (ID, NAME)"
-                  " VALUES (?, ?)");
-    query.addBindValue(id);
-    query.addBindValue(d.name);
+        if (d.capabilities.features & Capabilities::AdaptiveChunks
+                && Client::getSettings().value("Network/AdaptiveChunks", true).toBool())
+        {
+            capabilities.features |= Capabilities::AdaptiveChunks;
+        }
+    }
 
-    if (!query.exec())
+    if (d.capabilities.features & Capabilities::ResumableTransfers
+            && Client::getSettings().value("Network/ResumableTransfers", true).toBool())
     {
-        Client::error(query.lastError().text());
+        capabilities.features |= Capabilities::ResumableTransfers;
     }
 
-    emit setName(d.name);
+    if (d.capabilities.features & Capabilities::Digests
+            && Client::getSettings().value("Network/Digests", true).toBool())
+    {
+        capabilities.features |= Capabilities::Digests;
+    }
 
-    if (!d.motd.isEmpty())
+    if (d.capabilities.features & Capabilities::Compression
+            && Client::getSettings().value("Network/Compression", true).toBool())
     {
-        emit print(tr("Welcome message: %1").arg(d.motd));
+        capabilities.features |= Capabilities::Compression;
     }
 
-    for (const auto &room : d.rooms)
+    if (d.capabilities.features & Capabilities::Resumption
+            && Client::getSettings().value("Network/Resumption", true).toBool())
     {
-        query.prepare("INSERT OR REPLACE INTO ROOMS (ID, ID_SERVER, NAME)"
-                      " VALUES (?, ?, ?)");
-        query.addBindValue(room.id);
-        query.addBindValue(id);
-        query.addBindValue(room.name);
+        capabilities.features |= Capabilities::Resumption;
 
-        if (!query.exec())
+        if (tickets.contains(id) && tickets.value(id).expiry <= QDateTime::currentSecsSinceEpoch())
         {
-            Client::error(query.lastError().text());
+            tickets.remove(id);
         }
 
-        emit insertRoom(room.id,
-                        room.name);
+        // The ticket stands in for the signature check and the encapsulation,
+        // the server answers before either side switches keys
+        if (tickets.contains(id))
+        {
+            const auto &ticket = tickets[id];
+
+            resumption_secret = ticket.secret;
+            nonce.resize(KeySchedule::NONCE_SIZE);
+
+            CryptoPP::AutoSeededRandomPool().GenerateBlock(reinterpret_cast<quint8 *>(nonce.data()),
+                                                           size_t(nonce.size()));
+
+            sendOne<PacketType::Handshake>(
+                        ClientKeyExchange
+            {
+                {},
+                capabilities,
+                ticket.ticket,
+                nonce,
+                suite
+            });
+            return;
+        }
     }
+
+    exchangeKeys();
 }
 
-void Server::doUserState(UserState d)
+void Server::doResumption(ReResumption d)
 {
-    if (id_room.isEmpty())
+    if (nonce.isEmpty())
     {
         close(tr("Server sent invalid data"));
         return;
     }
 
-    switch (d.state)
+    switch (d.response)
     {
-    case UserState::Joined:
+    case ReResumption::Accepted:
     {
-        emit participantJoined(d.id);
+        shared_secret = KeySchedule::resumedSecret(resumption_secret,
+                                                   nonce,
+                                                   id,
+                                                   handshake.public_key[1]);
+        nonce.clear();
+
+        establish();
     }
     break;
 
-    case UserState::Left:
+    case ReResumption::Rejected:
     {
-        emit participantLeft(d.id);
+        nonce.clear();
+        tickets.remove(id);
+
+        exchangeKeys();
     }
     break;
     }
 }
 
-void Server::doMessage(Message d)
+void Server::exchangeKeys()
 {
-    if (id_room.isEmpty())
+    const auto &d = handshake;
+
+    if (!KeyEncapsulation(suite.kem).isAvailable())
     {
-        close(tr("Server sent invalid data"));
+        // Ask once for the most preferred key exchange both sides have
+        for (auto alternative : KeyEncapsulation::available())
+        {
+            if (!retried && (suite.kems & (1u << alternative)))
+            {
+                retried = true;
+                suite.kem = alternative;
+                handshake = {};
+
+                sendOne<PacketType::Handshake>(
+                            ClientKeyExchange
+                {
+                    {},
+                    capabilities,
+                    {},
+                    {},
+                    suite
+                });
+                return;
+            }
+        }
+
+        close(tr("The server supports no key exchange available here"));
         return;
     }
 
-    QSqlQuery query(db);
-    query.prepare("INSERT INTO ARCHIVE (TIMESTAMP, ID_SERVER, ID_MESSAGE, ID_ROOM, ID_SENDER, CONTENT)"
-                  " VALUES (?, ?, ?, ?, ?, ?)");
-    query.addBindValue(d.timestamp);
-    query.addBindValue(id);
-    query.addBindValue(d.id);
-    query.addBindValue(id_room);
-    query.addBindValue(d.id_sender);
-    query.addBindValue(d.content);
-
-    if (!query.exec())
+    if (!DigitalSignature(suite.signature).isAvailable())
     {
-        Client::error(query.lastError().text());
+        close(tr("The server signature algorithm is not available here"));
+        return;
     }
 
-    emit messageReceived(QDateTime::fromSecsSinceEpoch(d.timestamp),
-                         d.id_sender,
-                         d.content);
-}
+    QByteArray id;
 
-void Server::doReRoom(ReRoom d)
+    SHA3_512 hash;
+    id.resize(hash.DigestSize());
+
+    ArraySource(d.public_key->constData(),
+                d.public_key->size(), true,
+                new HashFilter(
+                    hash,
+                    new ArraySink(reinterpret_cast<quint8 *>(id.data()), id.size())
+                ));
+
+    if (id != this->id)
+    {
+        close(tr("Server signature public key verification failed"));
+        return;
+    }
+
+    // Both are independent until ClientKeyExchange is sent, so they run in
+    // parallel and leave the worker thread to the other connections
+    const auto selected = suite;
+
+    verification->setFuture(QtConcurrent::run(Client::getCryptoPool(), [ = ]
+    {
+        return DigitalSignature(selected.signature).verify(DigitalSignature::content(selected, d.public_key[1]),
+                                                           d.signature,
+                                                           d.public_key[0]);
+    }));
+    encapsulation->setFuture(QtConcurrent::run(Client::getCryptoPool(), [ = ]
+    {
+        Encapsulation result;
+        result.ok = KeyEncapsulation(selected.kem).encapsulate(d.public_key[1],
+                                                               result.ciphertext,
+                                                               result.shared_secret);
+        return result;
+    }));
+}
+
+void Server::onKeysExchanged()
 {
-    switch (d.response)
+    if (!verification->isFinished()
+            || !encapsulation->isFinished()
+            || interruptionRequested
+            || !socket->isOpen())
     {
-    case ReRoom::Joined:
+        return;
+    }
+
+    if (!verification->result())
     {
-        emit joinedRoom();
+        close(tr("Server ephemeral public key verification failed"));
+        return;
+    }
+
+    auto result = encapsulation->result();
+
+    if (!result.ok)
+    {
+        close(tr("Failed to reach shared secret"));
+        return;
+    }
+
+    shared_secret = result.shared_secret;
+
+    sendOne<PacketType::Handshake>(
+                ClientKeyExchange
+    {
+        result.ciphertext,
+        capabilities,
+        {},
+        {},
+        suite
+    });
+
+    establish();
+}
+
+void Server::establish()
+{
+    if (capabilities.features & Capabilities::SessionKeys)
+    {
+        transport->setSessionKeys(shared_secret,
+                                  SessionCipher::Client,
+                                  capabilities.features & Capabilities::AesGcm
+                                  ? SessionCipher::Aes256Gcm
+                                  : SessionCipher::ChaCha20Poly1305);
+    }
+    else
+    {
+        transport->setSecret(shared_secret);
+    }
+
+    // Both sides switch to the selected framing and encoding after the key exchange
+    if (capabilities.encoding != Capabilities::Absent)
+    {
+        transport->setEncoding(capabilities.encoding);
+    }
+
+    if (capabilities.features & Capabilities::PagedHistory)
+    {
+        pagedHistory = true;
+        historyPageSize = Client::getSettings().value("Network/HistoryPageSize",
+                                                      DEFAULT_HISTORY_PAGE_SIZE).toUInt();
+    }
+
+    if (capabilities.features & Capabilities::Compression)
+    {
+        transport->setCompressionThreshold(Client::getSettings().value("Network/CompressionThreshold",
+                                                                       DEFAULT_COMPRESSION_THRESHOLD).toLongLong());
+    }
+
+    if (capabilities.features & Capabilities::LargeFrames)
+    {
+        transport->setMaxFrameSize(capabilities.max_frame_size);
+        chunkSize = qMax(File::PAGE_SIZE,
+                         (capabilities.max_frame_size - UPLOAD_OVERHEAD) / File::PAGE_SIZE * File::PAGE_SIZE);
+    }
+
+    if (capabilities.features & Capabilities::Windowed)
+    {
+        windowLimit = Client::getSettings().value("Network/TransferWindow",
+                                                  TransferWindow::DEFAULT_LIMIT).toUInt();
+    }
+
+    if (capabilities.features & Capabilities::AdaptiveChunks)
+    {
+        adaptiveChunks = true;
+    }
+
+    if (capabilities.features & Capabilities::ResumableTransfers)
+    {
+        resumableTransfers = true;
 
         QSqlQuery query(db);
-        query.prepare("SELECT ID_MESSAGE"
-                      " FROM ARCHIVE"
+        query.prepare("DELETE FROM TRANSFERS"
                       " WHERE ID_SERVER = ?"
-                      " AND ID_ROOM = ?"
-                      " ORDER BY ID DESC"
-                      " LIMIT 1");
+                      " AND EXPIRY <= ?");
         query.addBindValue(id);
-        query.addBindValue(id_room);
+        query.addBindValue(QDateTime::currentSecsSinceEpoch());
+
+        if (!query.exec())
+        {
+            Client::error(query.lastError().text());
+        }
+
+        checkpointTimer->start();
+    }
+
+    if (capabilities.features & Capabilities::Digests)
+    {
+        digests = true;
+    }
+
+    if (capabilities.features & Capabilities::Resumption)
+    {
+        resumption_secret = KeySchedule::resumptionSecret(shared_secret);
+    }
+
+    sendOne<PacketType::RtAuthorization>(
+                RtAuthorization
+    {
+        username.toUtf8(),
+        password.toUtf8(),
+        signup
+        ? RtAuthorization::Signup
+        : RtAuthorization::Signin
+    });
+}
+
+void Server::doSessionTicket(SessionTicket d)
+{
+    if (!(capabilities.features & Capabilities::Resumption))
+    {
+        close(tr("Server sent invalid data"));
+        return;
+    }
+
+    auto lifetime = qBound(qint64(0), d.lifetime, MAX_TICKET_LIFETIME);
+
+    tickets.insert(id,
+    {
+        d.ticket,
+        resumption_secret,
+        QDateTime::currentSecsSinceEpoch() + lifetime
+    });
+}
+
+void Server::doReAuthorization(ReAuthorization d)
+{
+    switch (d.error)
+    {
+    case ReAuthorization::InvalidUsername:
+    {
+        close(tr("No user found with this username"));
+    }
+    break;
+
+    case ReAuthorization::InvalidPassword:
+    {
+        close(tr("You entered the wrong password"));
+    }
+    break;
+
+    case ReAuthorization::UserExists:
+    {
+        close(tr("Username already taken"));
+    }
+    break;
+
+    default:
+        ;
+    }
+}
+
+void Server::doEstablished(Established d)
+{
+    emit print(tr("Connected"));
+
+    QSqlQuery query(db);
+    query.prepare("INSERT OR REPLACE INTO SERVERS (ID, NAME)"
+                  " VALUES (?, ?)");
+    query.addBindValue(id);
+    query.addBindValue(d.name);
+
+    if (!query.exec())
+    {
+        Client::error(query.lastError().text());
+    }
+
+    emit setName(d.name);
+
+    if (!d.motd.isEmpty())
+    {
+        emit print(tr("Welcome message: %1").arg(d.motd));
+    }
+
+    for (const auto &room : d.rooms)
+    {
+        query.prepare("INSERT OR REPLACE INTO ROOMS (ID, ID_SERVER, NAME)"
+                      " VALUES (?, ?, ?)");
+        query.addBindValue(room.id);
+        query.addBindValue(id);
+        query.addBindValue(room.name);
 
         if (!query.exec())
         {
             Client::error(query.lastError().text());
         }
 
-        if (!query.next())
+        emit insertRoom(room.id,
+                        room.name);
+    }
+}
+
+void Server::doUserState(UserState d)
+{
+    if (id_room.isEmpty())
+    {
+        close(tr("Server sent invalid data"));
+        return;
+    }
+
+    switch (d.state)
+    {
+    case UserState::Joined:
+    {
+        emit participantJoined(d.id);
+    }
+    break;
+
+    case UserState::Left:
+    {
+        emit participantLeft(d.id);
+    }
+    break;
+    }
+}
+
+void Server::doMessage(Message d)
+{
+    if (id_room.isEmpty())
+    {
+        close(tr("Server sent invalid data"));
+        return;
+    }
+
+    QSqlQuery query(db);
+    query.prepare("INSERT INTO ARCHIVE (TIMESTAMP, ID_SERVER, ID_MESSAGE, ID_ROOM, ID_SENDER, CONTENT)"
+                  " VALUES (?, ?, ?, ?, ?, ?)");
+    query.addBindValue(d.timestamp);
+    query.addBindValue(id);
+    query.addBindValue(d.id);
+    query.addBindValue(id_room);
+    query.addBindValue(d.id_sender);
+    query.addBindValue(d.content);
+
+    if (!query.exec())
+    {
+        Client::error(query.lastError().text());
+    }
+
+    emit messageReceived(QDateTime::fromSecsSinceEpoch(d.timestamp),
+                         d.id_sender,
+                         d.content);
+}
+
+void Server::doMessageBatch(MessageBatch d)
+{
+    if (id_room.isEmpty())
+    {
+        close(tr("Server sent invalid data"));
+        return;
+    }
+
+    if (!d.messages.isEmpty())
+    {
+        // One transaction for the whole batch instead of one per message
+        if (!db.transaction())
+        {
+            Client::error(db.lastError().text());
+        }
+
+        QSqlQuery query(db);
+        query.prepare("INSERT INTO ARCHIVE (TIMESTAMP, ID_SERVER, ID_MESSAGE, ID_ROOM, ID_SENDER, CONTENT)"
+                      " VALUES (?, ?, ?, ?, ?, ?)");
+
+        for (const auto &message : d.messages)
+        {
+            query.bindValue(0, message.timestamp);
+            query.bindValue(1, id);
+            query.bindValue(2, message.id);
+            query.bindValue(3, id_room);
+            query.bindValue(4, message.id_sender);
+            query.bindValue(5, message.content);
+
+            if (!query.exec())
+            {
+                Client::error(query.lastError().text());
+            }
+        }
+
+        if (!db.commit())
         {
-            return;
+            Client::error(db.lastError().text());
+        }
+    }
+
+    auto requested = history;
+    history = History::Idle;
+
+    switch (requested)
+    {
+    case History::Idle:
+    {
+        if (!d.messages.isEmpty())
+        {
+            emit messagesReceived(d.messages);
+        }
+    }
+    return;
+
+    case History::Newest:
+    {
+        historyCursor = d.cursor;
+        saveGap(historyFloor, historyCursor);
+
+        if (!d.messages.isEmpty())
+        {
+            emit messagesReceived(d.messages);
+        }
+    }
+    break;
+
+    case History::Older:
+    {
+        historyCursor = d.cursor;
+        saveGap(historyFloor, historyCursor);
+
+        emit historyReceived(d.messages);
+    }
+    break;
+
+    // Only archived, the pages are older than anything shown
+    case History::Gap:
+    {
+        saveGap(gapFloor, d.cursor);
+    }
+    break;
+    }
+
+    if (historyRequested)
+    {
+        loadHistory();
+    }
+    else
+    {
+        fillGap();
+    }
+}
+
+// Messages after floor and older than cursor are still missing from the
+// archive. The floor stays until the gap is filled, a later join archives
+// from a newer one.
+void Server::saveGap(const QByteArray &floor, const QByteArray &cursor)
+{
+    // Without a floor nothing older was archived, so there is no gap
+    if (floor.isEmpty())
+    {
+        return;
+    }
+
+    QSqlQuery query(db);
+
+    if (cursor.isEmpty())
+    {
+        query.prepare("DELETE FROM GAPS"
+                      " WHERE ID_SERVER = ?"
+                      " AND ID_ROOM = ?"
+                      " AND FLOOR = ?");
+        query.addBindValue(id);
+        query.addBindValue(id_room);
+        query.addBindValue(floor);
+    }
+    else
+    {
+        query.prepare("INSERT OR REPLACE INTO GAPS (ID_SERVER, ID_ROOM, FLOOR, CURSOR)"
+                      " VALUES (?, ?, ?, ?)");
+        query.addBindValue(id);
+        query.addBindValue(id_room);
+        query.addBindValue(floor);
+        query.addBindValue(cursor);
+    }
+
+    if (!query.exec())
+    {
+        Client::error(query.lastError().text());
+    }
+}
+
+// Gaps left by earlier sessions are filled in the background, the one of
+// this session is left to scrolling back
+void Server::fillGap()
+{
+    if (!pagedHistory
+            || id_room.isEmpty()
+            || history != History::Idle)
+    {
+        return;
+    }
+
+    QSqlQuery query(db);
+    query.prepare("SELECT FLOOR, CURSOR"
+                  " FROM GAPS"
+                  " WHERE ID_SERVER = ?"
+                  " AND ID_ROOM = ?");
+    query.addBindValue(id);
+    query.addBindValue(id_room);
+
+    if (!query.exec())
+    {
+        Client::error(query.lastError().text());
+        return;
+    }
+
+    while (query.next())
+    {
+        auto floor = query.value(0).toByteArray();
+
+        if (floor == historyFloor)
+        {
+            continue;
+        }
+
+        gapFloor = floor;
+        history = History::Gap;
+
+        sendOne<PacketType::Synchronize>(
+                    Synchronize
+        {
+            floor,
+            query.value(1).toByteArray(),
+            historyPageSize
+        });
+        return;
+    }
+}
+
+void Server::doReRoom(ReRoom d)
+{
+    switch (d.response)
+    {
+    case ReRoom::Joined:
+    {
+        emit joinedRoom();
+
+        // Pages fetched while scrolling back are archived after newer messages,
+        // so the newest message is found by time rather than by insertion order
+        QSqlQuery query(db);
+        query.prepare("SELECT ID_MESSAGE"
+                      " FROM ARCHIVE"
+                      " WHERE ID_SERVER = ?"
+                      " AND ID_ROOM = ?"
+                      " ORDER BY TIMESTAMP DESC, ID DESC"
+                      " LIMIT 1");
+        query.addBindValue(id);
+        query.addBindValue(id_room);
+
+        if (!query.exec())
+        {
+            Client::error(query.lastError().text());
+        }
+
+        if (pagedHistory)
+        {
+            historyFloor = query.next()
+                           ? query.value(0).toByteArray()
+                           : QByteArray();
+            historyCursor.clear();
+            history = History::Newest;
+
+            sendOne<PacketType::Synchronize>(
+                        Synchronize
+            {
+                historyFloor,
+                {},
+                historyPageSize
+            });
+        }
+        else if (query.next())
+        {
+            sendOne<PacketType::Synchronize>(
+                        Synchronize
+            {
+                query.value(0).toByteArray(),
+                {},
+                0
+            });
+        }
+    }
+    break;
+
+    case ReRoom::Left:
+    {
+        emit leftRoom();
+    }
+    break;
+    }
+}
+
+void Server::doReUpload(ReUpload d)
+{
+    if (!usershare.contains(d.id))
+    {
+        close(tr("Server sent invalid data"));
+        return;
+    }
+
+    switch (d.response)
+    {
+    case ReUpload::ErrorOccurred:
+    {
+        auto file = usershare.value(d.id);
+
+        // The server may no longer have what was transferred before
+        if (d.error == ReUpload::BadRequest && file->getConfirmed())
+        {
+            file->rewind();
+            emit transferResumed(d.id, 0);
+
+            startTransfer(file, checkpoints.value(d.id).request);
+            return;
+        }
+
+        removeTransfer(d.id);
+
+        switch (d.error)
+        {
+        case ReUpload::InternalServerError:
+        {
+            emit print(tr("Server reported an internal error"));
+        }
+        break;
+
+        case ReUpload::BadRequest:
+        {
+            emit print(tr("The requested file has a different size on the server"));
+        }
+        break;
+
+        case ReUpload::NotFound:
+        {
+            emit print(tr("The requested file was not found on the server"));
+        }
+        break;
+
+        default:
+            ;
+        }
+    }
+    break;
+
+    case ReUpload::ReadyRead:
+    {
+        if (windowLimit)
+        {
+            auto &window = usershare.value(d.id)->getWindow();
+            window.setLimit(windowLimit);
+            window.setChunkLimits(adaptiveChunks ? TransferWindow::MIN_CHUNK_SIZE : chunkSize, chunkSize);
+
+            scheduler.add(d.id, &window, usershare.value(d.id)->getPriority());
+            schedule();
+            break;
+        }
+
+        doUploadState(
+        {
+            d.id,
+            UploadState::Next,
+            0
+        });
+    }
+    break;
+
+    case ReUpload::ReadyWrite:
+    {
+        if (windowLimit)
+        {
+            auto &window = usershare.value(d.id)->getWindow();
+            window.setLimit(windowLimit);
+
+            downloads.add(d.id, &window, usershare.value(d.id)->getPriority());
+            arrival.start();
+        }
+
+        sendOne<PacketType::UploadState>(
+                    UploadState
+        {
+            d.id,
+            UploadState::Next,
+            0
+        });
+    }
+    break;
+    }
+}
+
+void Server::doUpload(Upload d)
+{
+    if (!usershare.contains(d.id))
+    {
+        // A window of chunks may still be in flight after a cancellation
+        if (!windowLimit)
+        {
+            close(tr("Server sent invalid data"));
+        }
+
+        return;
+    }
+
+    auto file = usershare.value(d.id);
+
+    if (file->isCancellationRequested())
+    {
+        removeTransfer(d.id);
+        return;
+    }
+
+    if (d.chunkdata.isEmpty())
+    {
+        close(tr("Server sent an empty data chunk"));
+        return;
+    }
+
+    if (d.chunkdata.size() > file->getRemained())
+    {
+        close(tr("Server sent more data than required"));
+        return;
+    }
+
+    if (windowLimit && !file->getWindow().receive(d.sequence))
+    {
+        close(tr("Server sent a chunk out of order"));
+        return;
+    }
+
+    file->write(d.chunkdata);
+    file->confirm(file->getLastWritten());
+
+    file->getLimiter().consume(d.chunkdata.size());
+    downloadLimiter.consume(d.chunkdata.size());
+
+    // Downloads with digests are through once verified
+    if (!digests || !file->atEnd())
+    {
+        emit chunkTransferred(d.id, file->getLastWritten(), getLimit(file, downloadLimiter));
+    }
+
+    if (file->atEnd())
+    {
+        downloads.remove(d.id);
+
+        // The last chunk is acknowledged at once, after whatever was held back
+        for (const auto &state : acknowledgements.take(d.id))
+        {
+            sendOne<PacketType::UploadState>(state);
+        }
+
+        // With digests the transfer ends once the server answers with its own
+        if (digests)
+        {
+            received.insert(d.id, file->getLastWritten());
+        }
+        else
+        {
+            removeTransfer(d.id);
+        }
+
+        sendOne<PacketType::UploadState>(
+                    UploadState
+        {
+            d.id,
+            UploadState::Completed,
+            d.sequence,
+            digests ? file->getDigest() : QByteArray()
+        });
+    }
+    else
+    {
+        UploadState state
+        {
+            d.id,
+            UploadState::Next,
+            d.sequence
+        };
+
+        // Acknowledgements of windowed downloads go out in their turn
+        if (windowLimit)
+        {
+            arrival.start();
+
+            acknowledgements[d.id].enqueue(state);
+            schedule();
+            return;
+        }
+
+        // The server is held to the limits by holding back acknowledgements
+        auto delay = getDelay(file, downloadLimiter);
+
+        if (delay || acknowledgements.contains(d.id))
+        {
+            acknowledgements[d.id].enqueue(state);
+            wake(delay);
+            return;
+        }
+
+        sendOne<PacketType::UploadState>(state);
+    }
+}
+
+void Server::doUploadState(UploadState d)
+{
+    if (!usershare.contains(d.id))
+    {
+        // Acknowledgements may still be in flight after a cancellation
+        if (!windowLimit)
+        {
+            close(tr("Server sent invalid data"));
+        }
+
+        return;
+    }
+
+    auto file = usershare.value(d.id);
+
+    if (received.contains(d.id))
+    {
+        auto length = received.take(d.id);
+
+        if (d.state != UploadState::Completed)
+        {
+            close(tr("Server sent invalid data"));
+            return;
+        }
+
+        if (recordDigest(file, d.digest))
+        {
+            emit chunkTransferred(d.id, length, getLimit(file, downloadLimiter));
+        }
+        else
+        {
+            // Nothing announces or previews what is left of it
+            file->discard();
+            emit transferFailed(d.id);
+        }
+
+        removeTransfer(d.id);
+        return;
+    }
+
+    if (!windowLimit)
+    {
+        file->confirm(file->getLastRead());
+        emit chunkTransferred(d.id, file->getLastRead(), getLimit(file, uploadLimiter));
+    }
+    else
+    {
+        auto acknowledged = file->getWindow().acknowledge(d.sequence);
+
+        if (acknowledged < 0)
+        {
+            close(tr("Server sent invalid data"));
+            return;
+        }
+
+        file->confirm(acknowledged);
+        emit chunkTransferred(d.id, acknowledged, getLimit(file, uploadLimiter));
+    }
+
+    switch (d.state)
+    {
+    case UploadState::Next:
+    {
+        if (file->isCancellationRequested())
+        {
+            removeTransfer(d.id);
+            return;
+        }
+
+        if (windowLimit)
+        {
+            schedule();
+            break;
+        }
+
+        if (file->atEnd())
+        {
+            close(tr("Server requested more data than required"));
+            return;
+        }
+
+        if (auto delay = getDelay(file, uploadLimiter))
+        {
+            paced.insert(d.id);
+            wake(delay);
+            break;
+        }
+
+        sendChunk(file);
+    }
+    break;
+
+    case UploadState::Completed:
+    {
+        if (digests)
+        {
+            recordDigest(file, d.digest);
+
+            sendOne<PacketType::UploadState>(
+                        UploadState
+            {
+                d.id,
+                UploadState::Completed,
+                0,
+                file->getDigest()
+            });
+        }
+
+        removeTransfer(d.id);
+    }
+    break;
+
+    default:
+        ;
+    }
+}
+
+void Server::doPing(Ping d)
+{
+    disconnectTimer->start();
+
+    sendOne<PacketType::Pong>(d);
+}
+
+void Server::schedule()
+{
+    qint64 held = 0;
+
+    auto pending = [&](const QByteArray &id) -> qint64
+    {
+        const auto &file = usershare.value(id);
+
+        if (file->isCancellationRequested() || !acknowledgements.contains(id))
+        {
+            return 0;
+        }
+
+        if (auto delay = getDelay(file, downloadLimiter))
+        {
+            held = held ? qMin(held, delay) : delay;
+            return 0;
+        }
+
+        // Each acknowledgement lets about one more chunk of the same size in
+        return qMax(file->getLastWritten(), qint64(1));
+    };
+
+    QByteArray id;
+
+    while (!downloads.isEmpty() && !acknowledgements.isEmpty())
+    {
+        if (!isReleasing())
+        {
+            // Checked again once the server would have stalled
+            auto stall = qMax(STALL_TIMEOUT - arrival.elapsed(), qint64(1));
+            held = held ? qMin(held, stall) : stall;
+            break;
+        }
+
+        if ((id = downloads.next(pending)).isEmpty())
+        {
+            break;
+        }
+
+        auto &queue = acknowledgements[id];
+        auto state = queue.dequeue();
+
+        if (queue.isEmpty())
+        {
+            acknowledgements.remove(id);
+        }
+
+        usershare.value(id)->getWindow().release(state.sequence);
+
+        sendOne<PacketType::UploadState>(state);
+    }
+
+    wake(held);
+
+    if (scheduler.isEmpty())
+    {
+        return;
+    }
+
+    auto blocked = uploadLimiter.getDelay();
+    qint64 waiting = 0;
+
+    auto size = [&](const QByteArray &id) -> qint64
+    {
+        const auto &file = usershare.value(id);
+
+        if (file->isCancellationRequested())
+        {
+            return 0;
+        }
+
+        // Transfers over their own limits sit the round out
+        if (auto delay = file->getLimiter().getDelay())
+        {
+            waiting = waiting ? qMin(waiting, delay) : delay;
+            return 0;
+        }
+
+        return qMin(file->getWindow().getChunkSize(), file->getRemained());
+    };
+
+    while (!blocked && !(id = scheduler.next(size)).isEmpty())
+    {
+        auto file = usershare.value(id);
+        auto &window = file->getWindow();
+
+        auto chunk = file->read(window.getChunkSize());
+        auto sequence = window.send(chunk.size());
+
+        file->getLimiter().consume(chunk.size());
+        uploadLimiter.consume(chunk.size());
+        blocked = uploadLimiter.getDelay();
+
+        sendOne<PacketType::Upload>(
+                    Upload
+        {
+            id,
+            chunk,
+            sequence
+        });
+    }
+
+    wake(qMax(blocked, waiting));
+}
+
+// Downloads together keep about one window of the server in flight, the
+// largest it was seen to send ahead, so that acknowledgements held back are
+// handed out by weight
+bool Server::isReleasing()
+{
+    quint32 window = 0;
+    quint32 outstanding = 0;
+
+    for (const auto &file : usershare)
+    {
+        if (!downloads.contains(file->getId()))
+        {
+            continue;
+        }
+
+        window = qMax(window, file->getWindow().getAhead());
+        outstanding += file->getWindow().getOutstanding();
+    }
+
+    if (outstanding < window)
+    {
+        return true;
+    }
+
+    // Nothing arrives, so less is in flight than the windows make out
+    if (arrival.hasExpired(STALL_TIMEOUT))
+    {
+        for (const auto &file : usershare)
+        {
+            if (downloads.contains(file->getId()))
+            {
+                file->getWindow().resetAhead();
+            }
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+void Server::sendChunk(const QSharedPointer<File> &file)
+{
+    auto chunk = file->read(chunkSize);
+
+    file->getLimiter().consume(chunk.size());
+    uploadLimiter.consume(chunk.size());
+
+    sendOne<PacketType::Upload>(
+                Upload
+    {
+        file->getId(),
+        chunk,
+        0
+    });
+}
+
+void Server::wake(qint64 delay)
+{
+    if (delay && (!paceTimer->isActive() || paceTimer->remainingTime() > delay))
+    {
+        paceTimer->start(int(qMin<qint64>(delay, INT_MAX)));
+    }
+}
+
+qint64 Server::getDelay(const QSharedPointer<File> &file, RateLimiter &limiter)
+{
+    return qMax(file->getLimiter().getDelay(), limiter.getDelay());
+}
+
+qint64 Server::getLimit(const QSharedPointer<File> &file, const RateLimiter &limiter)
+{
+    auto own = file->getLimiter().getRate();
+    auto shared = limiter.getRate();
+
+    return own && (!shared || own < shared) ? own : shared;
+}
+
+void Server::requestTransfer(const QSharedPointer<File> &file, RtUpload::Request request)
+{
+    if (!resumableTransfers)
+    {
+        usershare.insert(file->getId(), file);
+        startTransfer(file, request);
+        return;
+    }
+
+    file->setResumable(true);
+
+    QSqlQuery query(db);
+    query.prepare("SELECT CONFIRMED, HASH"
+                  " FROM TRANSFERS"
+                  " WHERE ID_FILE = ?"
+                  " AND ID_SERVER = ?"
+                  " AND PATH = ?"
+                  " AND SIZE = ?"
+                  " AND REQUEST = ?"
+                  " AND EXPIRY > ?");
+    query.addBindValue(file->getId());
+    query.addBindValue(id);
+    query.addBindValue(file->getPath());
+    query.addBindValue(file->size());
+    query.addBindValue(request);
+    query.addBindValue(QDateTime::currentSecsSinceEpoch());
+
+    if (!query.exec())
+    {
+        Client::error(query.lastError().text());
+    }
+
+    if (!query.next() || query.value(0).toLongLong() < 1)
+    {
+        usershare.insert(file->getId(), file);
+        startTransfer(file, request);
+        return;
+    }
+
+    auto offset = query.value(0).toLongLong();
+    auto digest = query.value(1).toByteArray();
+
+    // Hashing what was transferred before may read gigabytes, away from the connection
+    auto watcher = new QFutureWatcher<bool>(this);
+
+    resuming.insert(file->getId(), file);
+
+    connect(watcher, &QFutureWatcherBase::finished, this, [ = ]
+    {
+        watcher->deleteLater();
+
+        // Canceled while it was checked
+        if (!resuming.remove(file->getId()))
+        {
+            file->requestCancellation();
+            return;
+        }
+
+        // Whatever the file holds now, the transfer starts over
+        if (!watcher->result())
+        {
+            file->rewind();
         }
 
-        sendOne(PacketType::Synchronize, QVariant::fromValue(
-                    Synchronize
-        {
-            query.value(0).toByteArray()
-        }));
-    }
-    break;
+        usershare.insert(file->getId(), file);
+        startTransfer(file, request);
+    });
 
-    case ReRoom::Left:
+    watcher->setFuture(QtConcurrent::run(Client::getCryptoPool(), [ = ]
     {
-        emit leftRoom();
-    }
-    break;
-    }
+        return file->resume(offset, digest);
+    }));
 }
 
-void Server::doReUpload(ReUpload d)
+void Server::startTransfer(const QSharedPointer<File> &file, RtUpload::Request request)
 {
-    if (!usershare.contains(d.id))
+    auto id = file->getId();
+
+    if (file->isCancellationRequested())
     {
-        close(tr("Server sent invalid data"));
+        removeTransfer(id);
         return;
     }
 
-    switch (d.response)
-    {
-    case ReUpload::ErrorOccurred:
+    if (resumableTransfers)
     {
-        usershare.remove(d.id);
+        QSqlQuery query(db);
+        query.prepare("INSERT OR REPLACE INTO TRANSFERS (ID_FILE, ID_SERVER, PATH, SIZE, REQUEST, CONFIRMED, HASH, EXPIRY)"
+                      " VALUES (?, ?, ?, ?, ?, ?, ?, ?)");
+        query.addBindValue(id);
+        query.addBindValue(this->id);
+        query.addBindValue(file->getPath());
+        query.addBindValue(file->size());
+        query.addBindValue(request);
+        query.addBindValue(file->getConfirmed());
+        query.addBindValue(file->getHash());
+        query.addBindValue(QDateTime::currentSecsSinceEpoch() + TRANSFER_LIFETIME);
 
-        switch (d.error)
-        {
-        case ReUpload::InternalServerError:
+        if (!query.exec())
         {
-            emit print(tr("Server reported an internal error"));
+            Client::error(query.lastError().text());
         }
-        break;
 
-        case ReUpload::BadRequest:
-        {
-            emit print(tr("The requested file has a different size on the server"));
-        }
-        break;
+        checkpoints.insert(id, {request, file->getConfirmed()});
 
-        case ReUpload::NotFound:
+        if (file->getConfirmed())
         {
-            emit print(tr("The requested file was not found on the server"));
-        }
-        break;
-
-        default:
-            ;
+            emit transferResumed(id, file->getConfirmed());
         }
     }
-    break;
 
-    case ReUpload::ReadyRead:
+    sendOne<PacketType::RtUpload>(
+                RtUpload
     {
-        doUploadState(
-        {
-            d.id,
-            UploadState::Next
-        });
-    }
-    break;
+        id,
+        file->size(),
+        request,
+        file->getConfirmed()
+    });
+}
 
-    case ReUpload::ReadyWrite:
+void Server::removeTransfer(const QByteArray &id)
+{
+    scheduler.remove(id);
+    downloads.remove(id);
+    usershare.remove(id);
+    checkpoints.remove(id);
+    received.remove(id);
+    paced.remove(id);
+    acknowledgements.remove(id);
+
+    // Whatever the transfer had in flight is free for the others
+    schedule();
+
+    if (!resumableTransfers)
     {
-        sendOne(PacketType::UploadState, QVariant::fromValue(
-                    UploadState
-        {
-            d.id,
-            UploadState::Next
-        }));
+        return;
     }
-    break;
+
+    QSqlQuery query(db);
+    query.prepare("DELETE FROM TRANSFERS"
+                  " WHERE ID_FILE = ?"
+                  " AND ID_SERVER = ?");
+    query.addBindValue(id);
+    query.addBindValue(this->id);
+
+    if (!query.exec())
+    {
+        Client::error(query.lastError().text());
     }
 }
 
-void Server::doUpload(Upload d)
+bool Server::recordDigest(const QSharedPointer<File> &file, const QByteArray &digest)
 {
-    if (!usershare.contains(d.id))
+    if (digest != file->getDigest())
     {
-        close(tr("Server sent invalid data"));
-        return;
+        emit print(file->isWritable()
+                   ? tr("%1 was corrupted in transfer and has been removed").arg(file->getName())
+                   : tr("%1 was corrupted in transfer").arg(file->getName()));
+        return false;
     }
 
-    auto file = usershare.value(d.id);
+    // Verified digests identify the content of files for later transfers
+    QSqlQuery query(db);
+    query.prepare("INSERT OR REPLACE INTO FILES (ID_FILE, ID_SERVER, PATH, SIZE, DIGEST)"
+                  " VALUES (?, ?, ?, ?, ?)");
+    query.addBindValue(file->getId());
+    query.addBindValue(id);
+    query.addBindValue(file->getPath());
+    query.addBindValue(file->size());
+    query.addBindValue(digest);
 
-    if (file->isCancellationRequested())
+    if (!query.exec())
     {
-        usershare.remove(d.id);
-        return;
+        Client::error(query.lastError().text());
     }
 
-    if (d.chunkdata.isEmpty())
+    cacheFile(file, digest);
+    return true;
+}
+
+void Server::cacheFile(const QSharedPointer<File> &file, const QByteArray &digest)
+{
+    FileCache cache(db);
+    auto size = file->size();
+
+    if (cache.contains(digest))
     {
-        close(tr("Server sent an empty data chunk"));
+        cache.insert(digest, size);
         return;
     }
 
-    if (d.chunkdata.size() > file->getRemained())
+    if (size > FileCache::getMaxSize())
     {
-        close(tr("Server sent more data than required"));
         return;
     }
 
-    file->write(d.chunkdata);
-
-    emit chunkTransferred(d.id, file->getLastWritten());
+    // The copy holds on to the file, so a temporary one outlives the transfer
+    auto watcher = new QFutureWatcher<bool>(this);
 
-    if (file->atEnd())
+    connect(watcher, &QFutureWatcherBase::finished, this, [ = ]
     {
-        usershare.remove(d.id);
+        watcher->deleteLater();
 
-        sendOne(PacketType::UploadState, QVariant::fromValue(
-                    UploadState
+        if (watcher->result())
         {
-            d.id,
-            UploadState::Completed
-        }));
-    }
-    else
+            FileCache(db).insert(digest, size);
+        }
+    });
+
+    watcher->setFuture(QtConcurrent::run(QThreadPool::globalInstance(), [ = ]
     {
-        sendOne(PacketType::UploadState, QVariant::fromValue(
-                    UploadState
-        {
-            d.id,
-            UploadState::Next
-        }));
-    }
+        return FileCache::store(file->getPath(), digest);
+    }));
 }
 
-void Server::doUploadState(UploadState d)
+void Server::checkpoint()
 {
-    if (!usershare.contains(d.id))
+    auto expiry = QDateTime::currentSecsSinceEpoch() + TRANSFER_LIFETIME;
+
+    for (auto i = checkpoints.begin(); i != checkpoints.end(); ++i)
     {
-        close(tr("Server sent invalid data"));
-        return;
-    }
+        auto file = usershare.value(i.key());
 
-    auto file = usershare.value(d.id);
+        if (!file || file->getConfirmed() == i->confirmed)
+        {
+            continue;
+        }
+
+        QSqlQuery query(db);
+        query.prepare("UPDATE TRANSFERS"
+                      " SET CONFIRMED = ?, HASH = ?, EXPIRY = ?"
+                      " WHERE ID_FILE = ?"
+                      " AND ID_SERVER = ?");
+        query.addBindValue(file->getConfirmed());
+        query.addBindValue(file->getHash());
+        query.addBindValue(expiry);
+        query.addBindValue(i.key());
+        query.addBindValue(id);
 
-    emit chunkTransferred(d.id, file->getLastRead());
+        if (!query.exec())
+        {
+            Client::error(query.lastError().text());
+        }
 
-    switch (d.state)
-    {
-    case UploadState::Next:
+        i->confirmed = file->getConfirmed();
+    }
+}
+
+void Server::pace()
+{
+    for (auto i = acknowledgements.begin(); i != acknowledgements.end(); )
     {
-        if (file->isCancellationRequested())
+        // Released by schedule() in their turn
+        if (downloads.contains(i.key()))
         {
-            usershare.remove(d.id);
-            return;
+            ++i;
+            continue;
         }
 
-        if (file->atEnd())
+        if (auto delay = getDelay(usershare.value(i.key()), downloadLimiter))
         {
-            close(tr("Server requested more data than required"));
-            return;
+            wake(delay);
+            ++i;
+            continue;
         }
 
-        sendOne(PacketType::Upload, QVariant::fromValue(
-                    Upload
+        for (const auto &state : *i)
         {
-            d.id,
-            file->read()
-        }));
+            sendOne<PacketType::UploadState>(state);
+        }
+
+        i = acknowledgements.erase(i);
     }
-    break;
 
-    case UploadState::Completed:
+    for (const auto &id : paced.values())
     {
-        usershare.remove(d.id);
-    }
-    break;
+        auto file = usershare.value(id);
 
-    default:
-        ;
+        if (auto delay = getDelay(file, uploadLimiter))
+        {
+            wake(delay);
+            continue;
+        }
+
+        paced.remove(id);
+        sendChunk(file);
     }
+
+    schedule();
 }
 
-void Server::doPing(Ping d)
+template <PacketType P, typename T>
+bool Server::dispatch(void (Server::*handler)(T))
 {
-    disconnectTimer->start();
+    static_assert(std::is_same<typename Inbound<P>::type, T>::value,
+                  "Handler does not match the packet type");
+
+    T d;
+
+    if (!transport->read(d))
+    {
+        return false;
+    }
 
-    sendOne(PacketType::Pong, QVariant::fromValue(d));
+    (this->*handler)(d);
+    return true;
 }
 
-void Server::sendOne(PacketType type, const QVariant &v)
+template <PacketType P>
+void Server::sendOne(const typename Outbound<P>::type &d)
 {
     if (interruptionRequested)
     {
@@ -688,54 +1887,31 @@ void Server::sendOne(PacketType type, const QVariant &v)
 
     writing = true;
 
-    QByteArray out;
-    QVector<quint8> crypto[2];
-
-    if (!v.isNull())
+    // File chunks are rarely worth the CPU time
+    if (!transport->write(quint8(P), d, P != PacketType::Upload))
     {
-        QDataStream ds(&out, QIODevice::WriteOnly);
-        v.save(ds);
-
-        if (encryption)
-        {
-            crypto[0].resize(enc.DigestSize());
-            crypto[1].resize(enc.DefaultIVLength());
-
-            enc.GetNextIV(rng, crypto[1].data());
-            enc.SetKeyWithIV(shared_secret.constData(),
-                             shared_secret.size(),
-                             crypto[1].constData(),
-                             crypto[1].size());
-            enc.EncryptAndAuthenticate(reinterpret_cast<quint8 *>(out.data()),
-                                       crypto[0].data(),
-                                       crypto[0].size(),
-                                       crypto[1].constData(),
-                                       crypto[1].size(),
-                                       nullptr,
-                                       0,
-                                       reinterpret_cast<const quint8 *>(out.constData()), out.size());
-        }
+        emit print(transport->getError());
+    }
+    else if (!flushTimer->isActive())
+    {
+        flushTimer->start();
     }
 
-    QByteArray t;
-    QDataStream ds(&t, QIODevice::WriteOnly);
+    writing = false;
+    emit written();
+}
 
-    ds << quint8(type) << quint16(out.size());
+void Server::flush()
+{
+    flushTimer->stop();
 
-    if (!v.isNull())
+    if (interruptionRequested)
     {
-        if (encryption)
-        {
-            ds.writeRawData(reinterpret_cast<const char *>(crypto[0].constData()), crypto[0].size());
-            ds.writeRawData(reinterpret_cast<const char *>(crypto[1].constData()), crypto[1].size());
-        }
-
-        ds.writeRawData(out.constData(), out.size());
+        return;
     }
 
-    socket->write(t.constData(), t.size());
-    socket->flush();
-
+    writing = true;
+    transport->flush();
     writing = false;
     emit written();
 }
@@ -750,18 +1926,35 @@ const QString &Server::getUsername() const
     return username;
 }
 
+const Transport::Statistics &Server::getWriteStatistics() const
+{
+    return transport->getStatistics();
+}
+
 bool Server::isTransferring() const
 {
-    return !usershare.empty();
+    return !usershare.empty() || !resuming.empty();
 }
 
 bool Server::isTransferExists(const QByteArray &id) const
 {
-    return usershare.contains(id);
+    return usershare.contains(id) || resuming.contains(id);
+}
+
+bool Server::hasTicket() const
+{
+    return tickets.contains(id);
 }
 
 void Server::cancelTransfer(QByteArray id)
 {
+    // The server hasn't heard of it yet, only the saved progress goes
+    if (resuming.remove(id))
+    {
+        removeTransfer(id);
+        return;
+    }
+
     if (!usershare.contains(id))
     {
         return;
@@ -769,68 +1962,135 @@ void Server::cancelTransfer(QByteArray id)
 
     usershare.value(id)->requestCancellation();
 
-    sendOne(PacketType::UploadState, QVariant::fromValue(
+    sendOne<PacketType::UploadState>(
                 UploadState
     {
         id,
-        UploadState::Canceled
-    }));
+        UploadState::Canceled,
+        0
+    });
+
+    // Nothing more comes for transfers held back by the limits, or for
+    // windowed uploads with no chunk left in flight
+    if (paced.contains(id)
+            || acknowledgements.contains(id)
+            || (scheduler.contains(id) && !usershare.value(id)->getWindow().getInFlight()))
+    {
+        removeTransfer(id);
+    }
 }
 
 void Server::joinRoom(QByteArray id)
 {
     id_room = id;
 
-    sendOne(PacketType::RtRoom, QVariant::fromValue(
+    history = History::Idle;
+    historyCursor.clear();
+    historyRequested = false;
+
+    sendOne<PacketType::RtRoom>(
                 RtRoom
     {
         id,
         RtRoom::Join
-    }));
+    });
 }
 
 void Server::leaveRoom()
 {
     id_room.clear();
 
-    sendOne(PacketType::RtRoom, QVariant::fromValue(
+    history = History::Idle;
+    historyCursor.clear();
+    historyRequested = false;
+
+    sendOne<PacketType::RtRoom>(
                 RtRoom
     {
         {},
         RtRoom::Leave
-    }));
+    });
 }
 
-void Server::receiveFile(QSharedPointer<File> file, QByteArray id)
+void Server::loadHistory()
 {
-    file->setId(id);
+    // Asked for again once the page of the gap being filled arrives
+    if (history == History::Gap)
+    {
+        historyRequested = true;
+        return;
+    }
 
-    usershare.insert(id, file);
+    historyRequested = false;
 
-    sendOne(PacketType::RtUpload, QVariant::fromValue(
-                RtUpload
+    if (!pagedHistory
+            || id_room.isEmpty()
+            || history != History::Idle
+            || historyCursor.isEmpty())
     {
-        id,
-        file->size(),
-        RtUpload::Receive
-    }));
+        return;
+    }
+
+    history = History::Older;
+
+    sendOne<PacketType::Synchronize>(
+                Synchronize
+    {
+        historyFloor,
+        historyCursor,
+        historyPageSize
+    });
+}
+
+void Server::receiveFile(QSharedPointer<File> file, QByteArray id)
+{
+    file->setId(id);
+    file->setDigested(digests);
+
+    requestTransfer(file, RtUpload::Receive);
 }
 
 void Server::sendFile(QSharedPointer<File> file)
 {
-    auto id = QUuid::createUuid().toRfc4122();
+    QByteArray id;
 
-    file->setId(id);
+    // An unfinished upload of the same file keeps its id, to be resumed
+    if (resumableTransfers)
+    {
+        QSqlQuery query(db);
+        query.prepare("SELECT ID_FILE"
+                      " FROM TRANSFERS"
+                      " WHERE ID_SERVER = ?"
+                      " AND PATH = ?"
+                      " AND SIZE = ?"
+                      " AND REQUEST = ?"
+                      " AND EXPIRY > ?");
+        query.addBindValue(this->id);
+        query.addBindValue(file->getPath());
+        query.addBindValue(file->size());
+        query.addBindValue(RtUpload::Transmit);
+        query.addBindValue(QDateTime::currentSecsSinceEpoch());
 
-    usershare.insert(id, file);
+        if (!query.exec())
+        {
+            Client::error(query.lastError().text());
+        }
 
-    sendOne(PacketType::RtUpload, QVariant::fromValue(
-                RtUpload
+        if (query.next())
+        {
+            id = query.value(0).toByteArray();
+        }
+    }
+
+    if (id.isEmpty() || isTransferExists(id))
     {
-        id,
-        file->size(),
-        RtUpload::Transmit
-    }));
+        id = QUuid::createUuid().toRfc4122();
+    }
+
+    file->setId(id);
+    file->setDigested(digests);
+
+    requestTransfer(file, RtUpload::Transmit);
 }
 
 void Server::sendMessage(qint64 timestamp, QString content)
@@ -852,12 +2112,46 @@ void Server::sendMessage(qint64 timestamp, QString content)
         Client::error(query.lastError().text());
     }
 
-    sendOne(PacketType::Message, QVariant::fromValue(
+    sendOne<PacketType::Message>(
                 Message
     {
         {},
         id,
         {},
         content
-    }));
+    });
+
+    flush();
+}
+
+void Server::setBandwidthLimits(qint64 upload, qint64 download)
+{
+    uploadLimiter.setRate(upload);
+    downloadLimiter.setRate(download);
+
+    pace();
+}
+
+void Server::setTransferLimit(QByteArray id, qint64 rate)
+{
+    if (!usershare.contains(id))
+    {
+        return;
+    }
+
+    usershare.value(id)->getLimiter().setRate(rate);
+
+    pace();
+}
+
+void Server::setTransferPriority(QByteArray id, int priority)
+{
+    if (!usershare.contains(id))
+    {
+        return;
+    }
+
+    usershare.value(id)->setPriority(TransferScheduler::Priority(priority));
+    scheduler.setPriority(id, TransferScheduler::Priority(priority));
+    downloads.setPriority(id, TransferScheduler::Priority(priority));
 }
@@ -1,17 +1,19 @@
 #ifndef SERVER_H
 #define SERVER_H
 
-#include "packet.h"
+#include "ratelimiter.h"
+#include "transferscheduler.h"
+#include "transport.h"
 
-#include <QDataStream>
+#include <QElapsedTimer>
+#include <QFutureWatcher>
 #include <QHash>
+#include <QQueue>
+#include <QSet>
 #include <QSqlDatabase>
 #include <QTcpSocket>
 #include <QTimer>
 
-#include <cryptopp/chachapoly.h>
-#include <cryptopp/osrng.h>
-
 class File;
 class Server : public QObject
 {
@@ -22,16 +24,22 @@ public:
 
     const QByteArray &getId() const;
     const QString &getUsername() const;
+    const Transport::Statistics &getWriteStatistics() const;
 
     bool isTransferring() const;
     bool isTransferExists(const QByteArray &) const;
+    bool hasTicket() const;
 
 signals:
-    void chunkTransferred(QByteArray, qint64);
+    void chunkTransferred(QByteArray, qint64, qint64);
+    void transferResumed(QByteArray, qint64);
+    void transferFailed(QByteArray);
     void insertRoom(QByteArray, QString);
     void joinedRoom();
     void leftRoom();
     void messageReceived(QDateTime, QString, QString);
+    void messagesReceived(QVector<Message>);
+    void historyReceived(QVector<Message>);
     void participantJoined(QString);
     void participantLeft(QString);
     void print(QString);
@@ -44,9 +52,13 @@ public slots:
     void cancelTransfer(QByteArray);
     void joinRoom(QByteArray);
     void leaveRoom();
+    void loadHistory();
     void receiveFile(QSharedPointer<File>, QByteArray);
     void sendFile(QSharedPointer<File>);
     void sendMessage(qint64, QString);
+    void setBandwidthLimits(qint64, qint64);
+    void setTransferLimit(QByteArray, qint64);
+    void setTransferPriority(QByteArray, int);
 
 signals:
     void read();
@@ -55,10 +67,39 @@ signals:
 private slots:
     void onDisconnected();
     void onReadyRead();
+    void onKeysExchanged();
+    void checkpoint();
+    void pace();
 
 private:
+    struct Encapsulation
+    {
+        bool ok = false;
+        QVector<quint8> ciphertext;
+        QVector<quint8> shared_secret;
+    };
+
+    struct Checkpoint
+    {
+        RtUpload::Request request;
+        qint64 confirmed;
+    };
+
+    struct Ticket
+    {
+        QByteArray ticket;
+        QVector<quint8> secret;
+        qint64 expiry;
+    };
+
+    // Tickets by server id, kept for this run only, as the secret alone
+    // resumes the session as the user. Servers all live in the worker thread.
+    static QHash<QByteArray, Ticket> tickets;
+
     QTcpSocket *socket;
-    QDataStream stream;
+
+    Transport *transport;
+    qint64 chunkSize;
 
     QString username;
     QString password;
@@ -67,34 +108,116 @@ private:
     QByteArray id;
     QByteArray id_room;
 
+    enum class History
+    {
+        Idle,
+        Newest,
+        Older,
+        Gap
+    };
+
+    bool pagedHistory;
+    quint32 historyPageSize;
+    History history;
+    QByteArray historyFloor;
+    QByteArray historyCursor;
+    // Older pages asked for while a gap left by an earlier session is filled
+    bool historyRequested;
+    QByteArray gapFloor;
+
+    // Most chunks in flight per transfer, none with stop-and-wait transfers
+    quint32 windowLimit;
+    // Chunk sizes follow the measured delivery rate within windows
+    bool adaptiveChunks;
+
+    // Progress of resumable transfers last saved to the database
+    bool resumableTransfers;
+    QHash<QByteArray, Checkpoint> checkpoints;
+    // Resumable transfers checking the part transferred before, away from
+    // everything else until the check is through
+    QHash<QByteArray, QSharedPointer<File>> resuming;
+
+    // Downloads written completely, waiting for the digest of the server,
+    // with the length of the last chunk, only reported once verified
+    bool digests;
+    QHash<QByteArray, qint64> received;
+
+    // Transfers held to the bandwidth limits: stop-and-wait uploads waiting
+    // to send their next chunk, and acknowledgements of downloads, which
+    // windowed downloads also wait in for their turn
+    RateLimiter uploadLimiter;
+    RateLimiter downloadLimiter;
+    QSet<QByteArray> paced;
+    QHash<QByteArray, QQueue<UploadState>> acknowledgements;
+
     bool interruptionRequested;
     bool reading;
     bool writing;
 
-    bool encryption;
+    ServerKeyExchange handshake;
+    Capabilities capabilities;
+    Suite suite;
+    bool retried;
     QVector<quint8> shared_secret;
+    QVector<quint8> resumption_secret;
+    QByteArray nonce;
 
-    CryptoPP::AutoSeededRandomPool rng;
-    CryptoPP::XChaCha20Poly1305::Decryption dec;
-    CryptoPP::XChaCha20Poly1305::Encryption enc;
+    QFutureWatcher<bool> *verification;
+    QFutureWatcher<Encapsulation> *encapsulation;
 
     QHash<QByteArray, QSharedPointer<File>> usershare;
+    // Chunks of windowed uploads, and acknowledgements of windowed downloads
+    // that let the server send the next chunk. The directions don't compete
+    // for the same link, so each is scheduled on its own.
+    TransferScheduler scheduler;
+    TransferScheduler downloads;
+    // Last chunk of a windowed download
+    QElapsedTimer arrival;
     QSqlDatabase db;
 
     QTimer *disconnectTimer;
+    QTimer *flushTimer;
+    QTimer *checkpointTimer;
+    QTimer *paceTimer;
 
     void doHandshake(ServerKeyExchange);
+    void doResumption(ReResumption);
+    void doSessionTicket(SessionTicket);
     void doReAuthorization(ReAuthorization);
     void doEstablished(Established);
     void doUserState(UserState);
     void doMessage(Message);
+    void doMessageBatch(MessageBatch);
     void doReRoom(ReRoom);
     void doReUpload(ReUpload);
     void doUpload(Upload);
     void doUploadState(UploadState);
     void doPing(Ping);
 
-    void sendOne(PacketType, const QVariant & = {});
+    void saveGap(const QByteArray &, const QByteArray &);
+    void fillGap();
+
+    void schedule();
+    bool isReleasing();
+    void sendChunk(const QSharedPointer<File> &);
+    void wake(qint64);
+    qint64 getDelay(const QSharedPointer<File> &, RateLimiter &);
+    qint64 getLimit(const QSharedPointer<File> &, const RateLimiter &);
+    void requestTransfer(const QSharedPointer<File> &, RtUpload::Request);
+    void startTransfer(const QSharedPointer<File> &, RtUpload::Request);
+    void removeTransfer(const QByteArray &);
+    bool recordDigest(const QSharedPointer<File> &, const QByteArray &);
+    void cacheFile(const QSharedPointer<File> &, const QByteArray &);
+
+    void exchangeKeys();
+    void establish();
+
+    bool handle(quint8);
+    template <PacketType P, typename T>
+    bool dispatch(void (Server::*)(T));
+    template <PacketType P>
+    void sendOne(const typename Outbound<P>::type &);
+    void flush();
 };
 
 #endif // SERVER_H
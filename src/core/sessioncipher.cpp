@@ -0,0 +1,132 @@
+#include "sessioncipher.h"
+
+#include <QtEndian>
+
+#include <cstring>
+
+#include <cryptopp/aes.h>
+#include <cryptopp/chachapoly.h>
+#include <cryptopp/cpu.h>
+#include <cryptopp/gcm.h>
+#include <cryptopp/hkdf.h>
+#include <cryptopp/sha.h>
+using CryptoPP::AES;
+using CryptoPP::GCM;
+using CryptoPP::HKDF;
+using CryptoPP::SHA256;
+
+static constexpr int KEY_SIZE = 32;
+static constexpr int NONCE_SIZE = 12;
+
+static const char CLIENT_LABEL[] = "neutron client write key";
+static const char SERVER_LABEL[] = "neutron server write key";
+
+constexpr int SessionCipher::TAG_SIZE;
+
+SessionCipher::SessionCipher()
+    : sent(0)
+    , received(0)
+{
+}
+
+bool SessionCipher::isAesAccelerated()
+{
+    #if CRYPTOPP_BOOL_X86 || CRYPTOPP_BOOL_X32 || CRYPTOPP_BOOL_X64
+    return CryptoPP::HasAESNI() && CryptoPP::HasCLMUL();
+    #elif CRYPTOPP_BOOL_ARM32 || CRYPTOPP_BOOL_ARMV8
+    return CryptoPP::HasAES() && CryptoPP::HasPMULL();
+    #else
+    return false;
+    #endif
+}
+
+void SessionCipher::setSecret(const QVector<quint8> &secret, Role role, Algorithm algorithm)
+{
+    quint8 key[2][KEY_SIZE];
+
+    HKDF<SHA256> kdf;
+
+    for (int i = 0; i < 2; i++)
+    {
+        auto label = i == 0 ? CLIENT_LABEL : SERVER_LABEL;
+
+        kdf.DeriveKey(key[i], KEY_SIZE,
+                      secret.constData(), size_t(secret.size()),
+                      nullptr, 0,
+                      reinterpret_cast<const quint8 *>(label), std::strlen(label));
+    }
+
+    switch (algorithm)
+    {
+    case ChaCha20Poly1305:
+    {
+        enc.reset(new CryptoPP::ChaCha20Poly1305::Encryption);
+        dec.reset(new CryptoPP::ChaCha20Poly1305::Decryption);
+    }
+    break;
+
+    case Aes256Gcm:
+    {
+        enc.reset(new GCM<AES>::Encryption);
+        dec.reset(new GCM<AES>::Decryption);
+    }
+    break;
+    }
+
+    quint8 iv[NONCE_SIZE];
+    nonce(0, iv);
+
+    enc->SetKeyWithIV(key[role == Client ? 0 : 1], KEY_SIZE, iv, NONCE_SIZE);
+    dec->SetKeyWithIV(key[role == Client ? 1 : 0], KEY_SIZE, iv, NONCE_SIZE);
+
+    sent = 0;
+    received = 0;
+}
+
+void SessionCipher::encrypt(quint8 *tag, quint8 *data, size_t length, const quint8 *aad, size_t aadLength)
+{
+    encrypt(sent++, tag, data, length, aad, aadLength);
+}
+
+bool SessionCipher::decrypt(const quint8 *tag, quint8 *data, size_t length, const quint8 *aad, size_t aadLength)
+{
+    return decrypt(received++, tag, data, length, aad, aadLength);
+}
+
+quint64 SessionCipher::claimSent()
+{
+    return sent++;
+}
+
+quint64 SessionCipher::claimReceived()
+{
+    return received++;
+}
+
+void SessionCipher::encrypt(quint64 counter, quint8 *tag, quint8 *data, size_t length, const quint8 *aad, size_t aadLength)
+{
+    quint8 iv[NONCE_SIZE];
+    nonce(counter, iv);
+
+    enc->EncryptAndAuthenticate(data, tag, TAG_SIZE,
+                                iv, NONCE_SIZE,
+                                aad, aadLength,
+                                data, length);
+}
+
+bool SessionCipher::decrypt(quint64 counter, const quint8 *tag, quint8 *data, size_t length, const quint8 *aad, size_t aadLength)
+{
+    quint8 iv[NONCE_SIZE];
+    nonce(counter, iv);
+
+    return dec->DecryptAndVerify(data, tag, TAG_SIZE,
+                                 iv, NONCE_SIZE,
+                                 aad, aadLength,
+                                 data, length);
+}
+
+void SessionCipher::nonce(quint64 counter, quint8 *iv)
+{
+    qToBigEndian<quint32>(0, iv);
+    qToBigEndian(counter, iv + sizeof(quint32));
+}
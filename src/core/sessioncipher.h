@@ -0,0 +1,65 @@
+#ifndef SESSIONCIPHER_H
+#define SESSIONCIPHER_H
+
+#include <QVector>
+
+#include <memory>
+
+#include <cryptopp/cryptlib.h>
+
+// AEAD keyed once per session.
+//
+// Each direction gets its own key derived from the shared secret, and the
+// nonce is the number of frames sent in that direction so far. Nothing but
+// the tag travels with a frame; a replayed, dropped or reordered frame uses
+// the wrong nonce and fails to verify.
+//
+// ChaCha20-Poly1305 is the default. AES-256-GCM is several times faster
+// where the CPU implements AES and carry-less multiplication, and slower
+// than ChaCha20 everywhere else.
+class SessionCipher
+{
+public:
+    explicit SessionCipher();
+
+    enum Role
+    {
+        Client,
+        Server
+    };
+
+    enum Algorithm
+    {
+        ChaCha20Poly1305,
+        Aes256Gcm
+    };
+
+    static constexpr int TAG_SIZE = 16;
+
+    // Whether AES-GCM runs on dedicated instructions here
+    static bool isAesAccelerated();
+
+    void setSecret(const QVector<quint8> &, Role, Algorithm = ChaCha20Poly1305);
+
+    void encrypt(quint8 *, quint8 *, size_t, const quint8 *, size_t);
+    bool decrypt(const quint8 *, quint8 *, size_t, const quint8 *, size_t);
+
+    // Claims the nonce of the next frame each way, for frames processed
+    // by another instance keyed with the same secret
+    quint64 claimSent();
+    quint64 claimReceived();
+
+    void encrypt(quint64, quint8 *, quint8 *, size_t, const quint8 *, size_t);
+    bool decrypt(quint64, const quint8 *, quint8 *, size_t, const quint8 *, size_t);
+
+private:
+    std::unique_ptr<CryptoPP::AuthenticatedSymmetricCipher> enc;
+    std::unique_ptr<CryptoPP::AuthenticatedSymmetricCipher> dec;
+
+    quint64 sent;
+    quint64 received;
+
+    static void nonce(quint64, quint8 *);
+};
+
+#endif // SESSIONCIPHER_H
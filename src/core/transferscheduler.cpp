@@ -0,0 +1,141 @@
+#include "transferscheduler.h"
+
+constexpr qint64 TransferScheduler::QUANTUM;
+
+TransferScheduler::TransferScheduler()
+    : current(0)
+    , credited(false)
+{
+}
+
+bool TransferScheduler::isEmpty() const
+{
+    return entries.isEmpty();
+}
+
+bool TransferScheduler::contains(const QByteArray &id) const
+{
+    for (const auto &entry : entries)
+    {
+        if (entry.id == id)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void TransferScheduler::add(const QByteArray &id, TransferWindow *window, Priority priority)
+{
+    entries.append(
+    {
+        id,
+        window,
+        priority,
+        0
+    });
+}
+
+void TransferScheduler::remove(const QByteArray &id)
+{
+    for (int i = 0; i < entries.size(); ++i)
+    {
+        if (entries[i].id != id)
+        {
+            continue;
+        }
+
+        entries.remove(i);
+
+        if (i < current)
+        {
+            --current;
+        }
+        else if (i == current)
+        {
+            credited = false;
+        }
+
+        if (current >= entries.size())
+        {
+            current = 0;
+        }
+
+        return;
+    }
+}
+
+void TransferScheduler::setPriority(const QByteArray &id, Priority priority)
+{
+    for (auto &entry : entries)
+    {
+        if (entry.id == id)
+        {
+            entry.weight = priority;
+        }
+    }
+}
+
+QByteArray TransferScheduler::next(const std::function<qint64(const QByteArray &)> &size)
+{
+    if (!isOpen())
+    {
+        return {};
+    }
+
+    // Credit grows with every visit, so a transfer with something to send
+    // is picked within a few rounds however large its chunks are
+    for (int idle = 0; idle < entries.size(); )
+    {
+        auto &entry = entries[current];
+        auto chunk = size(entry.id);
+
+        if (chunk < 1)
+        {
+            // Nothing saved up while idle
+            entry.deficit = 0;
+            ++idle;
+            advance();
+            continue;
+        }
+
+        idle = 0;
+
+        if (!credited)
+        {
+            entry.deficit += entry.weight * QUANTUM;
+            credited = true;
+        }
+
+        if (entry.deficit >= chunk)
+        {
+            entry.deficit -= chunk;
+            return entry.id;
+        }
+
+        advance();
+    }
+
+    return {};
+}
+
+bool TransferScheduler::isOpen() const
+{
+    quint32 size = 0;
+    quint32 inFlight = 0;
+
+    for (const auto &entry : entries)
+    {
+        size += entry.window->getSize();
+        inFlight += entry.window->getInFlight();
+    }
+
+    return inFlight < size;
+}
+
+void TransferScheduler::advance()
+{
+    current = (current + 1) % entries.size();
+    credited = false;
+}
@@ -0,0 +1,66 @@
+#ifndef TRANSFERSCHEDULER_H
+#define TRANSFERSCHEDULER_H
+
+#include "transferwindow.h"
+
+#include <QByteArray>
+#include <QVector>
+
+#include <functional>
+
+// Chunks of concurrent windowed transfers sharing one connection.
+//
+// Together the transfers may keep as many chunks in flight as their windows
+// add up to, about one bandwidth-delay product. Each freed slot goes to the
+// next transfer by deficit round-robin, weighted by priority, so transfers
+// share the link in proportion to their weights whatever their chunk sizes,
+// and one that starts late gets its share from the next round on.
+//
+// Downloads are scheduled the same way by the acknowledgements that let the
+// sender go on, their windows only number the chunks received.
+class TransferScheduler
+{
+public:
+    TransferScheduler();
+
+    // Weights of the priorities
+    enum Priority
+    {
+        Low = 1,
+        Normal = 2,
+        High = 4
+    };
+
+    // Credit per round for each unit of weight
+    static constexpr qint64 QUANTUM = 32768;
+
+    bool isEmpty() const;
+    bool contains(const QByteArray &) const;
+
+    void add(const QByteArray &, TransferWindow *, Priority = Normal);
+    void remove(const QByteArray &);
+    void setPriority(const QByteArray &, Priority);
+
+    // Transfer that sends the next chunk, none if the budget is spent or no
+    // transfer has anything to send. The function gives the size of the next
+    // chunk of a transfer, 0 if it has none.
+    QByteArray next(const std::function<qint64(const QByteArray &)> &);
+
+private:
+    struct Entry
+    {
+        QByteArray id;
+        TransferWindow *window;
+        qint64 weight;
+        qint64 deficit;
+    };
+
+    QVector<Entry> entries;
+    int current;
+    bool credited;
+
+    bool isOpen() const;
+    void advance();
+};
+
+#endif // TRANSFERSCHEDULER_H
@@ -0,0 +1,153 @@
+#include "transferwindow.h"
+
+#include <cmath>
+
+// Weight of a new delivery rate sample
+static constexpr double RATE_GAIN = 0.125;
+
+constexpr quint32 TransferWindow::MIN_SIZE;
+constexpr quint32 TransferWindow::DEFAULT_LIMIT;
+constexpr quint32 TransferWindow::MAX_LIMIT;
+constexpr qint64 TransferWindow::MIN_CHUNK_SIZE;
+constexpr qint64 TransferWindow::INITIAL_CHUNK_SIZE;
+constexpr qint64 TransferWindow::CHUNK_DURATION;
+
+TransferWindow::TransferWindow()
+    : size(MIN_SIZE)
+    , limit(DEFAULT_LIMIT)
+    , sequence(0)
+    , received(0)
+    , released(0)
+    , ahead(0)
+    , chunkSize(INITIAL_CHUNK_SIZE)
+    , minChunkSize(INITIAL_CHUNK_SIZE)
+    , maxChunkSize(INITIAL_CHUNK_SIZE)
+    , delivered(0)
+    , minRtt(0)
+    , rate(0)
+{
+    clock.start();
+}
+
+quint32 TransferWindow::getSize() const
+{
+    return size;
+}
+
+quint32 TransferWindow::getInFlight() const
+{
+    return quint32(inFlight.size());
+}
+
+quint32 TransferWindow::getReceived() const
+{
+    return received;
+}
+
+qint64 TransferWindow::getChunkSize() const
+{
+    return chunkSize;
+}
+
+void TransferWindow::setLimit(quint32 limit)
+{
+    this->limit = qBound(MIN_SIZE, limit, MAX_LIMIT);
+    size = qMin(size, this->limit);
+}
+
+void TransferWindow::setChunkLimits(qint64 lower, qint64 upper)
+{
+    minChunkSize = qMax(MIN_CHUNK_SIZE, lower);
+    maxChunkSize = qMax(minChunkSize, upper);
+    chunkSize = qBound(minChunkSize, INITIAL_CHUNK_SIZE, maxChunkSize);
+}
+
+bool TransferWindow::isOpen() const
+{
+    return quint32(inFlight.size()) < size;
+}
+
+quint32 TransferWindow::send(qint64 length)
+{
+    inFlight.enqueue(
+    {
+        ++sequence,
+        length,
+        clock.nsecsElapsed(),
+        delivered
+    });
+
+    return sequence;
+}
+
+qint64 TransferWindow::acknowledge(quint32 sequence)
+{
+    if (sequence > this->sequence
+            || (!inFlight.isEmpty() && sequence + 1 < inFlight.head().sequence)
+            || (inFlight.isEmpty() && sequence != this->sequence))
+    {
+        return -1;
+    }
+
+    qint64 length = 0;
+    auto now = clock.nsecsElapsed();
+
+    while (!inFlight.isEmpty() && inFlight.head().sequence <= sequence)
+    {
+        auto chunk = inFlight.dequeue();
+
+        length += chunk.size;
+        delivered += chunk.size;
+
+        auto rtt = qMax(now - chunk.sent, qint64(1));
+        auto sample = double(delivered - chunk.delivered) / rtt;
+
+        minRtt = minRtt ? qMin(minRtt, rtt) : rtt;
+        rate = rate > 0 ? rate + RATE_GAIN * (sample - rate) : sample;
+    }
+
+    if (length > 0)
+    {
+        // Whole pages keep file reads aligned
+        auto target = qint64(rate * CHUNK_DURATION) / MIN_CHUNK_SIZE * MIN_CHUNK_SIZE;
+        chunkSize = qBound(minChunkSize, target, maxChunkSize);
+
+        auto bdp = rate * minRtt / chunkSize;
+
+        size = qBound(MIN_SIZE, quint32(std::ceil(bdp)) + MIN_SIZE, limit);
+    }
+
+    return length;
+}
+
+bool TransferWindow::receive(quint32 sequence)
+{
+    if (sequence != received + 1)
+    {
+        return false;
+    }
+
+    received = sequence;
+    ahead = qMax(ahead, received - released);
+    return true;
+}
+
+void TransferWindow::release(quint32 sequence)
+{
+    released = qMax(released, sequence);
+}
+
+quint32 TransferWindow::getAhead() const
+{
+    return ahead;
+}
+
+quint32 TransferWindow::getOutstanding() const
+{
+    return released + ahead - received;
+}
+
+void TransferWindow::resetAhead()
+{
+    ahead = received - released;
+}
@@ -0,0 +1,83 @@
+#ifndef TRANSFERWINDOW_H
+#define TRANSFERWINDOW_H
+
+#include <QElapsedTimer>
+#include <QQueue>
+
+// Chunks of one file transfer in flight, with windowed transfers.
+//
+// Chunks are numbered from 1 and acknowledged cumulatively. The window
+// follows the bandwidth-delay product measured from the acknowledgements,
+// plus a couple of chunks: enough to keep the link busy, and not so many
+// that chat frames queue behind a long tail of file data.
+//
+// With adaptive chunks the chunk size follows the delivery rate as well, so
+// that a chunk holds the link for about CHUNK_DURATION: large chunks on fast
+// links where per-frame overhead dominates, small ones on slow links where a
+// chat frame would otherwise wait behind a whole chunk.
+class TransferWindow
+{
+public:
+    TransferWindow();
+
+    static constexpr quint32 MIN_SIZE = 2;
+    static constexpr quint32 DEFAULT_LIMIT = 64;
+    static constexpr quint32 MAX_LIMIT = 1024;
+    static constexpr qint64 MIN_CHUNK_SIZE = 4096;
+    static constexpr qint64 INITIAL_CHUNK_SIZE = 32768;
+    // In nanoseconds, like the round-trip times
+    static constexpr qint64 CHUNK_DURATION = 10000000;
+
+    quint32 getSize() const;
+    quint32 getInFlight() const;
+    quint32 getReceived() const;
+    qint64 getChunkSize() const;
+
+    void setLimit(quint32);
+    void setChunkLimits(qint64, qint64);
+
+    // Sender side
+    bool isOpen() const;
+    quint32 send(qint64);
+    qint64 acknowledge(quint32);
+
+    // Receiver side, chunks have to arrive in order
+    bool receive(quint32);
+    // Receiver side holding back acknowledgements: the furthest the sender
+    // was seen ahead of them is its window, and whatever it may still send
+    // without another acknowledgement is outstanding
+    void release(quint32);
+    quint32 getAhead() const;
+    quint32 getOutstanding() const;
+    // The sender's window may shrink, which is only seen once it stalls
+    void resetAhead();
+
+private:
+    struct Chunk
+    {
+        quint32 sequence;
+        qint64 size;
+        qint64 sent;
+        qint64 delivered;
+    };
+
+    QQueue<Chunk> inFlight;
+    QElapsedTimer clock;
+
+    quint32 size;
+    quint32 limit;
+    quint32 sequence;
+    quint32 received;
+    quint32 released;
+    quint32 ahead;
+
+    qint64 chunkSize;
+    qint64 minChunkSize;
+    qint64 maxChunkSize;
+
+    qint64 delivered;
+    qint64 minRtt;
+    double rate;
+};
+
+#endif // TRANSFERWINDOW_H
@@ -0,0 +1,569 @@
+#include "transport.h"
+#include "cryptopipeline.h"
+
+#include <QtEndian>
+
+#include <cstring>
+
+#include <zlib.h>
+
+// Type and length
+static constexpr qint64 HEADER_SIZE = sizeof(quint8) + sizeof(quint16);
+// Type and length once large frames are negotiated
+static constexpr qint64 LARGE_HEADER_SIZE = sizeof(quint8) + sizeof(quint32);
+// Bytes requested from the socket at once
+static constexpr qint64 READ_SIZE = 65536;
+// Set in the type byte of frames whose payload is compressed
+static constexpr quint8 COMPRESSED = 0x80;
+// Compressed payloads start with their inflated size, as qCompress writes it
+static constexpr qint64 INFLATED_SIZE = sizeof(quint32);
+// Payloads from this size on are encrypted and decrypted on the pipeline
+static constexpr quint32 PIPELINE_THRESHOLD = 16384;
+// Incoming frames handed to the pipeline ahead of the one being read
+static constexpr int MAX_PIPELINED = 8;
+
+constexpr quint32 Transport::LEGACY_FRAME_SIZE;
+constexpr quint32 Transport::DEFAULT_FRAME_SIZE;
+constexpr quint32 Transport::MAX_FRAME_SIZE;
+
+Transport::Transport(QObject *parent)
+    : QObject(parent)
+    , socket(nullptr)
+    , headerSize(HEADER_SIZE)
+    , maxFrameSize(LEGACY_FRAME_SIZE)
+    , encoding(Capabilities::Legacy)
+    , compression(false)
+    , compressionThreshold(0)
+    , encryption(false)
+    , sessionKeys(false)
+    , pipelineThread(nullptr)
+    , pipeline(nullptr)
+    , rx(READ_SIZE)
+    , current(0)
+    , pending(0)
+{
+    payloadDevice = new QBuffer(&payload, this);
+    payloadDevice->open(QIODevice::ReadOnly);
+    payloadStream.setDevice(payloadDevice);
+    payloadCompact.setDevice(payloadDevice);
+
+    txDevice = new QBuffer(&tx, this);
+    txDevice->open(QIODevice::WriteOnly);
+    txStream.setDevice(txDevice);
+    txCompact.setDevice(txDevice);
+}
+
+Transport::~Transport()
+{
+    if (!pipeline)
+    {
+        return;
+    }
+
+    // Nothing would ever delete it on a thread that is stopped or gone
+    auto thread = pipeline->thread();
+
+    if (thread && thread->isRunning())
+    {
+        pipeline->deleteLater();
+    }
+    else
+    {
+        delete pipeline;
+    }
+}
+
+const QString &Transport::getError() const
+{
+    return error;
+}
+
+quint32 Transport::getMaxFrameSize() const
+{
+    return maxFrameSize;
+}
+
+const Transport::Statistics &Transport::getStatistics() const
+{
+    return statistics;
+}
+
+bool Transport::isEncrypted() const
+{
+    return encryption;
+}
+
+void Transport::setSocket(QAbstractSocket *socket)
+{
+    this->socket = socket;
+}
+
+void Transport::setPipelineThread(QThread *thread)
+{
+    pipelineThread = thread;
+}
+
+void Transport::setSecret(const QVector<quint8> &secret)
+{
+    this->secret = secret;
+    encryption = true;
+}
+
+void Transport::setSessionKeys(const QVector<quint8> &secret,
+                               SessionCipher::Role role,
+                               SessionCipher::Algorithm algorithm)
+{
+    cipher.setSecret(secret, role, algorithm);
+    encryption = true;
+    sessionKeys = true;
+
+    if (pipelineThread)
+    {
+        pipeline = new CryptoPipeline(secret, role, algorithm);
+        pipeline->moveToThread(pipelineThread);
+
+        connect(pipeline, &CryptoPipeline::encrypted,
+                this, &Transport::onEncrypted);
+        connect(pipeline, &CryptoPipeline::decrypted,
+                this, &Transport::onDecrypted);
+    }
+}
+
+void Transport::setEncoding(Capabilities::Encoding encoding)
+{
+    this->encoding = encoding;
+}
+
+void Transport::setMaxFrameSize(quint32 size)
+{
+    headerSize = LARGE_HEADER_SIZE;
+    maxFrameSize = size;
+}
+
+void Transport::setCompressionThreshold(qint64 threshold)
+{
+    compression = true;
+    compressionThreshold = threshold;
+}
+
+bool Transport::receive()
+{
+    auto available = qMin(socket->bytesAvailable(), READ_SIZE);
+
+    if (available <= 0)
+    {
+        return false;
+    }
+
+    auto received = socket->read(rx.reserve(available), available);
+
+    if (received <= 0)
+    {
+        return false;
+    }
+
+    rx.commit(received);
+    statistics.received += quint64(received);
+    return true;
+}
+
+Transport::Status Transport::next(quint8 &type)
+{
+    // The previous frame stays readable until the next one is requested
+    rx.consume(current);
+    current = 0;
+
+    while (true)
+    {
+        // Frames go through in wire order, whichever thread decrypted them
+        if (!inbox.isEmpty() && inbox.head().done)
+        {
+            auto pipelined = inbox.dequeue();
+
+            if (!pipelined.ok)
+            {
+                error = tr("Failed to decrypt incoming packet");
+                return Error;
+            }
+
+            delivered = pipelined.frame;
+
+            auto frame = reinterpret_cast<const quint8 *>(delivered.constData());
+            auto offset = headerSize + SessionCipher::TAG_SIZE;
+
+            type = frame[0];
+            return open(type, frame + offset, quint32(delivered.size() - offset));
+        }
+
+        if (rx.size() < headerSize)
+        {
+            return Incomplete;
+        }
+
+        auto frame = reinterpret_cast<quint8 *>(rx.data());
+
+        type = frame[0];
+        auto length = headerSize == LARGE_HEADER_SIZE
+                      ? qFromBigEndian<quint32>(frame + 1)
+                      : qFromBigEndian<quint16>(frame + 1);
+
+        if (length > maxFrameSize)
+        {
+            error = tr("Received an oversized packet");
+            return Error;
+        }
+
+        const quint8 *crypto[2] {};
+        qint64 offset = headerSize;
+
+        // With session keys every frame carries a tag and nothing else
+        if (sessionKeys)
+        {
+            crypto[0] = frame + offset;
+            offset += SessionCipher::TAG_SIZE;
+        }
+        else if (length > 0 && encryption)
+        {
+            crypto[0] = frame + offset;
+            offset += dec.DigestSize();
+            crypto[1] = frame + offset;
+            offset += dec.DefaultIVLength();
+        }
+
+        if (rx.size() < offset + length)
+        {
+            return Incomplete;
+        }
+
+        auto data = frame + offset;
+
+        // Once a frame is on the pipeline, the ones behind it queue up too
+        if (pipeline && (!inbox.isEmpty() || length >= PIPELINE_THRESHOLD))
+        {
+            if (inbox.size() >= MAX_PIPELINED)
+            {
+                return Incomplete;
+            }
+
+            QByteArray copy(reinterpret_cast<const char *>(frame), int(offset + length));
+            rx.consume(offset + length);
+
+            if (length >= PIPELINE_THRESHOLD)
+            {
+                QMetaObject::invokeMethod(pipeline, "decrypt",
+                                          Q_ARG(quint64, cipher.claimReceived()),
+                                          Q_ARG(QByteArray, copy),
+                                          Q_ARG(int, int(headerSize)));
+
+                inbox.enqueue({{}, false, false});
+            }
+            else
+            {
+                auto data = reinterpret_cast<quint8 *>(copy.data());
+                auto ok = cipher.decrypt(data + headerSize,
+                                         data + offset, length,
+                                         data, size_t(headerSize));
+
+                inbox.enqueue({copy, true, ok});
+            }
+
+            continue;
+        }
+
+        if (sessionKeys)
+        {
+            // The header is authenticated too, so the type can't be swapped
+            if (!cipher.decrypt(crypto[0], data, length, frame, size_t(headerSize)))
+            {
+                error = tr("Failed to decrypt incoming packet");
+                return Error;
+            }
+        }
+        else if (length > 0 && encryption)
+        {
+            dec.SetKeyWithIV(secret.constData(),
+                             secret.size(),
+                             crypto[1],
+                             dec.DefaultIVLength());
+
+            if (!dec.DecryptAndVerify(data,
+                                      crypto[0],
+                                      dec.DigestSize(),
+                                      crypto[1],
+                                      dec.DefaultIVLength(),
+                                      nullptr,
+                                      0,
+                                      data, length))
+            {
+                error = tr("Failed to decrypt incoming packet");
+                return Error;
+            }
+        }
+
+        current = offset + length;
+        return open(type, data, length);
+    }
+}
+
+Transport::Status Transport::open(quint8 &type, const quint8 *data, quint32 length)
+{
+    auto content = reinterpret_cast<const char *>(data);
+    auto size = int(length);
+
+    if (type & COMPRESSED)
+    {
+        type &= ~COMPRESSED;
+
+        // The buffer is sized from whatever is stored in front of the data
+        if (!compression
+                || length < INFLATED_SIZE
+                || qFromBigEndian<quint32>(data) > maxFrameSize)
+        {
+            error = tr("Received invalid data");
+            return Error;
+        }
+
+        auto expected = qFromBigEndian<quint32>(data);
+        uLongf inflatedSize = expected;
+
+        // Shrinking keeps the capacity, so the buffer is only ever grown
+        inflated.resize(int(expected));
+
+        if (expected == 0
+                || uncompress(reinterpret_cast<Bytef *>(inflated.data()), &inflatedSize,
+                              data + INFLATED_SIZE, uLong(length - INFLATED_SIZE)) != Z_OK
+                || inflatedSize != expected)
+        {
+            error = tr("Failed to decompress incoming packet");
+            return Error;
+        }
+
+        content = inflated.constData();
+        size = inflated.size();
+    }
+
+    payload.setRawData(content, uint(size));
+    payloadDevice->seek(0);
+    payloadStream.resetStatus();
+    payloadCompact.resetStatus();
+
+    return Ok;
+}
+
+void Transport::onDecrypted(QByteArray frame, bool ok)
+{
+    for (auto &pipelined : inbox)
+    {
+        if (!pipelined.done)
+        {
+            pipelined = {frame, true, ok};
+            break;
+        }
+    }
+
+    emit readyRead();
+}
+
+qint64 Transport::beginFrame()
+{
+    // Frames queued since the last flush stay in front of this one
+    qint64 offset = pending + headerSize;
+
+    if (sessionKeys)
+    {
+        offset += SessionCipher::TAG_SIZE;
+    }
+    else if (encryption)
+    {
+        offset += enc.DigestSize() + enc.DefaultIVLength();
+    }
+
+    // Serialize right behind the room reserved for the header
+    txDevice->seek(offset);
+    return offset;
+}
+
+bool Transport::endFrame(quint8 type, qint64 offset, bool compressible)
+{
+    auto length = txDevice->pos() - offset;
+
+    if (compressible && compression && length > compressionThreshold)
+    {
+        auto bound = compressBound(uLong(length));
+        uLongf compressedSize = bound;
+
+        deflated.resize(int(INFLATED_SIZE + qint64(bound)));
+
+        auto compressed = reinterpret_cast<Bytef *>(deflated.data());
+        qToBigEndian(quint32(length), compressed);
+
+        if (compress2(compressed + INFLATED_SIZE, &compressedSize,
+                      reinterpret_cast<const Bytef *>(tx.constData()) + offset, uLong(length),
+                      Z_DEFAULT_COMPRESSION) == Z_OK
+                && INFLATED_SIZE + qint64(compressedSize) + compressionThreshold < length)
+        {
+            length = INFLATED_SIZE + qint64(compressedSize);
+            std::memcpy(tx.data() + offset, deflated.constData(), size_t(length));
+
+            type |= COMPRESSED;
+        }
+    }
+
+    if (length > maxFrameSize)
+    {
+        error = tr("Packet is too large to be sent");
+        return false;
+    }
+
+    auto frame = reinterpret_cast<quint8 *>(tx.data()) + pending;
+
+    frame[0] = type;
+
+    if (headerSize == LARGE_HEADER_SIZE)
+    {
+        qToBigEndian(quint32(length), frame + 1);
+    }
+    else
+    {
+        qToBigEndian(quint16(length), frame + 1);
+    }
+
+    if (pipeline && length >= PIPELINE_THRESHOLD)
+    {
+        submit(offset + length);
+        statistics.frames++;
+
+        return true;
+    }
+
+    if (sessionKeys)
+    {
+        cipher.encrypt(frame + headerSize,
+                       reinterpret_cast<quint8 *>(tx.data()) + offset, size_t(length),
+                       frame, size_t(headerSize));
+    }
+    else if (encryption)
+    {
+        auto tag = frame + headerSize;
+        auto iv = tag + enc.DigestSize();
+        auto data = reinterpret_cast<quint8 *>(tx.data()) + offset;
+
+        enc.GetNextIV(rng, iv);
+        enc.SetKeyWithIV(secret.constData(),
+                         secret.size(),
+                         iv,
+                         enc.DefaultIVLength());
+        enc.EncryptAndAuthenticate(data,
+                                   tag,
+                                   enc.DigestSize(),
+                                   iv,
+                                   enc.DefaultIVLength(),
+                                   nullptr,
+                                   0,
+                                   data, length);
+    }
+
+    pending = offset + length;
+    statistics.frames++;
+
+    return true;
+}
+
+void Transport::submit(qint64 end)
+{
+    QByteArray frame(tx.constData() + pending, int(end - pending));
+
+    // Frames queued before this one go out before it
+    if (outbox.isEmpty())
+    {
+        flush();
+    }
+    else if (pending > 0)
+    {
+        outbox.enqueue({QByteArray(tx.constData(), int(pending)), true, true});
+        pending = 0;
+    }
+
+    outbox.enqueue({{}, false, true});
+
+    QMetaObject::invokeMethod(pipeline, "encrypt",
+                              Q_ARG(quint64, cipher.claimSent()),
+                              Q_ARG(QByteArray, frame),
+                              Q_ARG(int, int(headerSize)));
+}
+
+void Transport::onEncrypted(QByteArray frame)
+{
+    for (auto &pipelined : outbox)
+    {
+        if (!pipelined.done)
+        {
+            pipelined.frame = frame;
+            pipelined.done = true;
+            break;
+        }
+    }
+
+    drain();
+}
+
+void Transport::drain()
+{
+    auto written = false;
+
+    while (!outbox.isEmpty() && outbox.head().done)
+    {
+        auto pipelined = outbox.dequeue();
+
+        socket->write(pipelined.frame);
+
+        statistics.writes++;
+        statistics.bytes += quint64(pipelined.frame.size());
+        written = true;
+    }
+
+    // Frames written meanwhile waited for the ones in front
+    if (outbox.isEmpty() && pending > 0)
+    {
+        socket->write(tx.constData(), pending);
+
+        statistics.writes++;
+        statistics.bytes += quint64(pending);
+        written = true;
+
+        pending = 0;
+    }
+
+    if (written)
+    {
+        socket->flush();
+    }
+}
+
+void Transport::flush()
+{
+    if (!outbox.isEmpty())
+    {
+        if (pending > 0)
+        {
+            outbox.enqueue({QByteArray(tx.constData(), int(pending)), true, true});
+            pending = 0;
+        }
+
+        drain();
+        return;
+    }
+
+    if (pending == 0)
+    {
+        return;
+    }
+
+    socket->write(tx.constData(), pending);
+    socket->flush();
+
+    statistics.writes++;
+    statistics.bytes += quint64(pending);
+
+    pending = 0;
+}
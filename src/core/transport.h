@@ -0,0 +1,170 @@
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include "codec.h"
+#include "framebuffer.h"
+#include "sessioncipher.h"
+
+#include <QAbstractSocket>
+#include <QBuffer>
+#include <QDataStream>
+#include <QQueue>
+#include <QThread>
+
+#include <cryptopp/chachapoly.h>
+#include <cryptopp/osrng.h>
+
+class CryptoPipeline;
+
+// Framing, encryption, compression and encoding of packets on a socket.
+//
+// Shared by both ends of the protocol: the parameters are negotiated by the
+// owner during the handshake and applied here once the key exchange is done.
+class Transport : public QObject
+{
+    Q_OBJECT
+public:
+    explicit Transport(QObject * = nullptr);
+    ~Transport();
+
+    enum Status
+    {
+        Ok,
+        Incomplete,
+        Error
+    };
+
+    // Divide by writes to get frames and bytes per socket write
+    struct Statistics
+    {
+        quint64 frames = 0;
+        quint64 writes = 0;
+        quint64 bytes = 0;
+        quint64 received = 0;
+    };
+
+    // Payload limits of the original and of the negotiated framing
+    static constexpr quint32 LEGACY_FRAME_SIZE = 0xFFFF;
+    static constexpr quint32 DEFAULT_FRAME_SIZE = 1 << 20;
+    static constexpr quint32 MAX_FRAME_SIZE = 1 << 24;
+
+    const QString &getError() const;
+    quint32 getMaxFrameSize() const;
+    const Statistics &getStatistics() const;
+
+    bool isEncrypted() const;
+
+    void setSocket(QAbstractSocket *);
+    // Large frames are encrypted there once session keys are set
+    void setPipelineThread(QThread *);
+    void setSecret(const QVector<quint8> &);
+    void setSessionKeys(const QVector<quint8> &, SessionCipher::Role,
+                        SessionCipher::Algorithm = SessionCipher::ChaCha20Poly1305);
+    void setEncoding(Capabilities::Encoding);
+    void setMaxFrameSize(quint32);
+    void setCompressionThreshold(qint64);
+
+    bool receive();
+    Status next(quint8 &);
+
+    template <typename T>
+    bool read(T &);
+    template <typename T>
+    bool write(quint8, const T &, bool = true);
+
+    void flush();
+
+signals:
+    // Frames decrypted on the pipeline are ready to be read with next()
+    void readyRead();
+
+private slots:
+    void onEncrypted(QByteArray);
+    void onDecrypted(QByteArray, bool);
+
+private:
+    // Frame still or no longer on the pipeline, in wire order
+    struct Pipelined
+    {
+        QByteArray frame;
+        bool done;
+        bool ok;
+    };
+
+    QAbstractSocket *socket;
+    QString error;
+
+    qint64 headerSize;
+    quint32 maxFrameSize;
+    Capabilities::Encoding encoding;
+    bool compression;
+    qint64 compressionThreshold;
+
+    bool encryption;
+    bool sessionKeys;
+    QVector<quint8> secret;
+    SessionCipher cipher;
+
+    QThread *pipelineThread;
+    CryptoPipeline *pipeline;
+    QQueue<Pipelined> inbox;
+    QQueue<Pipelined> outbox;
+    QByteArray delivered;
+
+    CryptoPP::AutoSeededRandomPool rng;
+    CryptoPP::XChaCha20Poly1305::Decryption dec;
+    CryptoPP::XChaCha20Poly1305::Encryption enc;
+
+    FrameBuffer rx;
+    qint64 current;
+    QByteArray inflated;
+    QByteArray payload;
+    QBuffer *payloadDevice;
+    QDataStream payloadStream;
+    CompactStream payloadCompact;
+
+    QByteArray tx;
+    QByteArray deflated;
+    qint64 pending;
+    QBuffer *txDevice;
+    QDataStream txStream;
+    CompactStream txCompact;
+    Statistics statistics;
+
+    Status open(quint8 &, const quint8 *, quint32);
+    void submit(qint64);
+    void drain();
+
+    qint64 beginFrame();
+    bool endFrame(quint8, qint64, bool);
+};
+
+template <typename T>
+bool Transport::read(T &d)
+{
+    return encoding == Capabilities::Compact
+           ? Codec::decode(payloadCompact, d)
+           : Codec::decode(payloadStream, d);
+}
+
+template <typename T>
+bool Transport::write(quint8 type, const T &d, bool compressible)
+{
+    auto offset = beginFrame();
+
+    // Nothing past the frames already queued is kept if encoding fails
+    if (encoding == Capabilities::Compact
+            ? !Codec::encode(txCompact, d)
+            : !Codec::encode(txStream, d))
+    {
+        txStream.resetStatus();
+        txCompact.resetStatus();
+
+        error = tr("Failed to serialize outgoing packet");
+        return false;
+    }
+
+    return endFrame(type, offset, compressible);
+}
+
+#endif // TRANSPORT_H
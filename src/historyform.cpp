@@ -107,7 +107,8 @@ void HistoryForm::refresh()
                   " AND ID_ROOM = ?"
                   " AND TIMESTAMP > ?"
                   " AND TIMESTAMP < ?"
-                  " AND CONTENT LIKE ?");
+                  " AND CONTENT LIKE ?"
+                  " ORDER BY TIMESTAMP, ID");
     query.addBindValue(id_server);
     query.addBindValue(id_room);
 
@@ -5,6 +5,7 @@
 #include "transferdialog.h"
 #include "core/client.h"
 #include "core/file.h"
+#include "core/filecache.h"
 #include "core/server.h"
 
 #include <KActionMenu>
@@ -13,6 +14,7 @@
 #include <QDateTime>
 #include <QDesktopServices>
 #include <QFileDialog>
+#include <QFileInfo>
 #include <QHostAddress>
 #include <QImageReader>
 #include <QInputDialog>
@@ -21,8 +23,11 @@
 #include <QMimeDatabase>
 #include <QMimeData>
 #include <QNetworkProxy>
+#include <QScrollBar>
 #include <QSharedPointer>
 #include <QSound>
+#include <QSqlError>
+#include <QSqlQuery>
 #include <QTcpSocket>
 #include <QUrlQuery>
 
@@ -46,6 +51,8 @@ MainWindow::MainWindow(QWidget *parent)
             this, &MainWindow::onItemDoubleClicked);
     connect(ui->lineEdit, &QLineEdit::returnPressed,
             this, &MainWindow::onReturnPressed);
+    connect(ui->chatBrowser->verticalScrollBar(), &QScrollBar::valueChanged,
+            this, &MainWindow::onScrolled);
 
     connect(ui->actionConnect, &QAction::triggered,
             this, &MainWindow::onConnect);
@@ -54,6 +61,9 @@ MainWindow::MainWindow(QWidget *parent)
     connect(ui->actionLeave_Room, &QAction::triggered,
             this, &MainWindow::onLeaveRoom);
 
+    connect(ui->actionBandwidth_Limits, &QAction::triggered,
+            this, &MainWindow::onBandwidthLimits);
+
     connect(ui->actionHistory, &QAction::triggered,
             this, &MainWindow::onHistory);
 
@@ -187,7 +197,61 @@ void MainWindow::onAnchorClicked(const QUrl &url)
                 return;
             }
 
-            auto fileName = QFileDialog::getSaveFileName(this, {}, name);
+            // Files downloaded or sent before are copied from the cache
+            auto cached = FileCache().find(id, server->getId(), size);
+
+            if (!cached.isEmpty())
+            {
+                auto fileName = QFileDialog::getSaveFileName(this, {}, name);
+
+                if (fileName.isEmpty())
+                {
+                    return;
+                }
+
+                QFile::remove(fileName);
+
+                if (!QFile::copy(cached, fileName))
+                {
+                    ui->chatBrowser->append(tr("Unable to create file"));
+                    return;
+                }
+
+                // The preview is read from the cache rather than the saved copy
+                QSharedPointer<File> file(new File(cached));
+
+                if (file->open(QIODevice::ReadOnly))
+                {
+                    previewImage(file);
+                }
+
+                ui->chatBrowser->append(tr("%1 copied from the cache").arg(QFileInfo(fileName).fileName()));
+                return;
+            }
+
+            QSqlQuery query;
+            query.prepare("SELECT PATH"
+                          " FROM TRANSFERS"
+                          " WHERE ID_FILE = ?"
+                          " AND ID_SERVER = ?"
+                          " AND SIZE = ?"
+                          " AND REQUEST = ?"
+                          " AND EXPIRY > ?");
+            query.addBindValue(id);
+            query.addBindValue(server->getId());
+            query.addBindValue(size);
+            query.addBindValue(RtUpload::Receive);
+            query.addBindValue(QDateTime::currentSecsSinceEpoch());
+
+            if (!query.exec())
+            {
+                Client::error(query.lastError().text());
+            }
+
+            // An unfinished download continues in the file it was saved to
+            auto fileName = query.next() && QFileInfo(query.value(0).toString()).size() == size
+                            ? query.value(0).toString()
+                            : QFileDialog::getSaveFileName(this, {}, name);
 
             if (fileName.isEmpty())
             {
@@ -237,7 +301,7 @@ void MainWindow::onItemDoubleClicked(const QTreeWidgetItem *item)
         return;
     }
 
-    if (!check(false, true))
+    if (!check(false, false))
     {
         return;
     }
@@ -282,6 +346,17 @@ void MainWindow::onReturnPressed()
     sendMessage(message);
 }
 
+void MainWindow::onScrolled(int value)
+{
+    // Older history is loaded once the user scrolls back to the top
+    if (value != ui->chatBrowser->verticalScrollBar()->minimum())
+    {
+        return;
+    }
+
+    loadHistory();
+}
+
 void MainWindow::onConnect()
 {
     ConnectDialog d(this);
@@ -302,7 +377,7 @@ void MainWindow::onDisconnect()
 
 void MainWindow::onLeaveRoom()
 {
-    if (!check(true, true))
+    if (!check(true, false))
     {
         return;
     }
@@ -310,6 +385,41 @@ void MainWindow::onLeaveRoom()
     QMetaObject::invokeMethod(server, "leaveRoom");
 }
 
+void MainWindow::onBandwidthLimits()
+{
+    auto &settings = Client::getSettings();
+    bool ok;
+
+    // Limits are entered in KiB/s and kept in bytes per second, none for no limit
+    auto upload = QInputDialog::getInt(this, tr("Bandwidth Limits"), tr("Upload limit, KiB/s (0 for none):"),
+                                       int(settings.value("Network/UploadLimit", 0).toLongLong() / 1024),
+                                       0, 1048576, 1, &ok);
+
+    if (!ok)
+    {
+        return;
+    }
+
+    auto download = QInputDialog::getInt(this, tr("Bandwidth Limits"), tr("Download limit, KiB/s (0 for none):"),
+                                         int(settings.value("Network/DownloadLimit", 0).toLongLong() / 1024),
+                                         0, 1048576, 1, &ok);
+
+    if (!ok)
+    {
+        return;
+    }
+
+    settings.setValue("Network/UploadLimit", qint64(upload) * 1024);
+    settings.setValue("Network/DownloadLimit", qint64(download) * 1024);
+
+    if (server)
+    {
+        QMetaObject::invokeMethod(server, "setBandwidthLimits",
+                                  Q_ARG(qint64, qint64(upload) * 1024),
+                                  Q_ARG(qint64, qint64(download) * 1024));
+    }
+}
+
 void MainWindow::onHistory()
 {
     new HistoryForm(this);
@@ -324,35 +434,7 @@ void MainWindow::onInsertRoom(QByteArray id, QString name)
 
 void MainWindow::onFileReceived(QSharedPointer<File> file)
 {
-    QMimeDatabase db;
-    auto mime = db.mimeTypeForFile(*file)
-                .name()
-                .toLatin1();
-
-    if (QImageReader::supportedMimeTypes().contains(mime))
-    {
-        QImage image;
-        QImageReader reader(file.data());
-
-        file->seek(0);
-
-        if (!reader.read(&image))
-        {
-            ui->chatBrowser->append(tr("Cannot preview image"));
-            return;
-        }
-
-        if (image.width() > PREVIEW_SIZE || image.height() > PREVIEW_SIZE)
-        {
-            image = image.width() > image.height()
-                    ? image.scaledToWidth(PREVIEW_SIZE, Qt::SmoothTransformation)
-                    : image.scaledToHeight(PREVIEW_SIZE, Qt::SmoothTransformation);
-        }
-
-        ui->chatBrowser->moveCursor(QTextCursor::End);
-        ui->chatBrowser->textCursor().insertBlock();
-        ui->chatBrowser->textCursor().insertImage(image);
-    }
+    previewImage(file);
 
     ui->chatBrowser->append(tr("Download %1 completed").arg(file->getName()));
 }
@@ -392,6 +474,42 @@ void MainWindow::onMessageReceived(QDateTime dt, QString sender, QString message
     QSound::play(":/data/sounds/intuition.wav");
 }
 
+void MainWindow::onMessagesReceived(QVector<Message> messages)
+{
+    ui->chatBrowser->setUpdatesEnabled(false);
+
+    for (const auto &message : messages)
+    {
+        ui->chatBrowser->append(message.content,
+                                message.id_sender,
+                                QDateTime::fromSecsSinceEpoch(message.timestamp));
+    }
+
+    ui->chatBrowser->setUpdatesEnabled(true);
+
+    fillView();
+
+    if (isActiveWindow())
+    {
+        return;
+    }
+
+    QApplication::alert(this);
+    QSound::play(":/data/sounds/intuition.wav");
+}
+
+void MainWindow::onHistoryReceived(QVector<Message> messages)
+{
+    for (auto i = messages.crbegin(); i != messages.crend(); ++i)
+    {
+        ui->chatBrowser->prepend(i->content,
+                                 i->id_sender,
+                                 QDateTime::fromSecsSinceEpoch(i->timestamp));
+    }
+
+    fillView();
+}
+
 void MainWindow::onParticipantJoined(QString id)
 {
     ui->listWidget->addItem(id);
@@ -455,6 +573,60 @@ bool MainWindow::check(bool participant, bool transfer)
     return result;
 }
 
+void MainWindow::fillView()
+{
+    // There is nothing to scroll back with until the pages fill the view
+    if (ui->chatBrowser->verticalScrollBar()->maximum() > 0)
+    {
+        return;
+    }
+
+    loadHistory();
+}
+
+void MainWindow::loadHistory()
+{
+    if (!server || !roomParticipant)
+    {
+        return;
+    }
+
+    QMetaObject::invokeMethod(server, "loadHistory");
+}
+
+void MainWindow::previewImage(const QSharedPointer<File> &file)
+{
+    QMimeDatabase db;
+    auto mime = db.mimeTypeForFile(*file)
+                .name()
+                .toLatin1();
+
+    if (QImageReader::supportedMimeTypes().contains(mime))
+    {
+        QImage image;
+        QImageReader reader(file.data());
+
+        file->seek(0);
+
+        if (!reader.read(&image))
+        {
+            ui->chatBrowser->append(tr("Cannot preview image"));
+            return;
+        }
+
+        if (image.width() > PREVIEW_SIZE || image.height() > PREVIEW_SIZE)
+        {
+            image = image.width() > image.height()
+                    ? image.scaledToWidth(PREVIEW_SIZE, Qt::SmoothTransformation)
+                    : image.scaledToHeight(PREVIEW_SIZE, Qt::SmoothTransformation);
+        }
+
+        ui->chatBrowser->moveCursor(QTextCursor::End);
+        ui->chatBrowser->textCursor().insertBlock();
+        ui->chatBrowser->textCursor().insertImage(image);
+    }
+}
+
 void MainWindow::connectToHost(const QString &server_id,
                                const QString &server_host, int server_port,
                                const QString &username, const QString &password, bool signup,
@@ -501,6 +673,10 @@ void MainWindow::connectToHost(const QString &server_id,
                 this, &MainWindow::onLeftRoom);
         connect(server, &Server::messageReceived,
                 this, &MainWindow::onMessageReceived);
+        connect(server, &Server::messagesReceived,
+                this, &MainWindow::onMessagesReceived);
+        connect(server, &Server::historyReceived,
+                this, &MainWindow::onHistoryReceived);
         connect(server, &Server::participantJoined,
                 this, &MainWindow::onParticipantJoined);
         connect(server, &Server::participantLeft,
@@ -1,6 +1,8 @@
 #ifndef MAINWINDOW_H
 #define MAINWINDOW_H
 
+#include "core/packet.h"
+
 #include <QMainWindow>
 #include <QPointer>
 #include <QTcpSocket>
@@ -28,6 +30,7 @@ private slots:
     void onAnchorClicked(const QUrl &);
     void onItemDoubleClicked(const QTreeWidgetItem *);
     void onReturnPressed();
+    void onScrolled(int);
 
     // menuServer
     void onConnect();
@@ -35,6 +38,8 @@ private slots:
     void onLeaveRoom();
 
     // menuSettings
+    void onBandwidthLimits();
+
     // menuView
     void onHistory();
 
@@ -43,6 +48,8 @@ private slots:
     void onInsertRoom(QByteArray, QString);
     void onLeftRoom();
     void onMessageReceived(QDateTime, QString, QString);
+    void onMessagesReceived(QVector<Message>);
+    void onHistoryReceived(QVector<Message>);
     void onParticipantJoined(QString);
     void onParticipantLeft(QString);
     void onPrint(QString);
@@ -61,6 +68,10 @@ private:
 
     bool check(bool, bool);
 
+    void fillView();
+    void loadHistory();
+
+    void previewImage(const QSharedPointer<File> &);
     void connectToHost(const QString &,
                        const QString &, int,
                        const QString &, const QString &, bool,
@@ -15,10 +15,23 @@ TransferDialog::TransferDialog(QWidget *parent, Server *server, const QSharedPoi
                          : tr("Sending"));
     ui->label_4->setText(file->getName());
 
+    ui->comboBox->addItem(tr("Low"), TransferScheduler::Low);
+    ui->comboBox->addItem(tr("Normal"), TransferScheduler::Normal);
+    ui->comboBox->addItem(tr("High"), TransferScheduler::High);
+    ui->comboBox->setCurrentIndex(ui->comboBox->findData(file->getPriority()));
+
     connect(ui->pushButton, &QPushButton::clicked,
             this, &TransferDialog::onCancel);
+    connect(ui->comboBox, QOverload<int>::of(&QComboBox::currentIndexChanged),
+            this, &TransferDialog::onPriorityChanged);
+    connect(ui->spinBox, QOverload<int>::of(&QSpinBox::valueChanged),
+            this, &TransferDialog::onLimitChanged);
     connect(server, &Server::chunkTransferred,
             this, &TransferDialog::onChunkTransferred);
+    connect(server, &Server::transferResumed,
+            this, &TransferDialog::onTransferResumed);
+    connect(server, &Server::transferFailed,
+            this, &TransferDialog::onTransferFailed);
     connect(server, &QObject::destroyed,
             this, &QObject::deleteLater);
 
@@ -34,7 +47,11 @@ TransferDialog::~TransferDialog()
 
 void TransferDialog::timerEvent(QTimerEvent *)
 {
-    ui->label_6->setText(locale().formattedDataSize(bytesTransferred / ++elapsedTime) + "/s");
+    auto speed = locale().formattedDataSize((bytesTransferred - bytesResumed) / ++elapsedTime) + "/s";
+
+    ui->label_6->setText(limit
+                         ? tr("%1 of %2").arg(speed, locale().formattedDataSize(limit) + "/s")
+                         : speed);
 }
 
 void TransferDialog::onCancel()
@@ -44,7 +61,21 @@ void TransferDialog::onCancel()
     deleteLater();
 }
 
-void TransferDialog::onChunkTransferred(QByteArray id, qint64 sz)
+void TransferDialog::onPriorityChanged()
+{
+    QMetaObject::invokeMethod(server, "setTransferPriority",
+                              Q_ARG(QByteArray, file->getId()),
+                              Q_ARG(int, ui->comboBox->currentData().toInt()));
+}
+
+void TransferDialog::onLimitChanged()
+{
+    QMetaObject::invokeMethod(server, "setTransferLimit",
+                              Q_ARG(QByteArray, file->getId()),
+                              Q_ARG(qint64, qint64(ui->spinBox->value()) * 1024));
+}
+
+void TransferDialog::onChunkTransferred(QByteArray id, qint64 sz, qint64 limit)
 {
     if (file->getId() != id)
     {
@@ -52,6 +83,7 @@ void TransferDialog::onChunkTransferred(QByteArray id, qint64 sz)
     }
 
     bytesTransferred += sz;
+    this->limit = limit;
 
     ui->progressBar->setValue((bytesTransferred * 100) / file->size());
 
@@ -63,3 +95,26 @@ void TransferDialog::onChunkTransferred(QByteArray id, qint64 sz)
     emit completed();
     deleteLater();
 }
+
+void TransferDialog::onTransferResumed(QByteArray id, qint64 offset)
+{
+    if (file->getId() != id)
+    {
+        return;
+    }
+
+    bytesTransferred = offset;
+    bytesResumed = offset;
+
+    ui->progressBar->setValue((bytesTransferred * 100) / file->size());
+}
+
+void TransferDialog::onTransferFailed(QByteArray id)
+{
+    if (file->getId() != id)
+    {
+        return;
+    }
+
+    deleteLater();
+}
@@ -24,7 +24,11 @@ signals:
 
 private slots:
     void onCancel();
-    void onChunkTransferred(QByteArray, qint64);
+    void onPriorityChanged();
+    void onLimitChanged();
+    void onChunkTransferred(QByteArray, qint64, qint64);
+    void onTransferResumed(QByteArray, qint64);
+    void onTransferFailed(QByteArray);
 
 private:
     Ui::TransferDialog *ui;
@@ -33,7 +37,9 @@ private:
     QSharedPointer<File> file;
 
     qint64 bytesTransferred = 0;
+    qint64 bytesResumed = 0;
     qint64 elapsedTime = 0;
+    qint64 limit = 0;
 };
 
 #endif // TRANSFERDIALOG_H